@@ -0,0 +1,425 @@
+/* AES-128-GCM authenticated encryption for packet payloads.
+
+   Built with -maes -mpclmul -mssse3, AES rounds use AES-NI and the GHASH
+   multiplications use carry-less multiply (PCLMULQDQ), with PSHUFB for the
+   byte reversal GHASH needs; otherwise a
+   portable byte-oriented AES and a bitwise GHASH are used.  Both give the
+   same output, which aeadbench.c checks against the test cases of the
+   GCM specification (McGrew and Viega, test cases 2 to 4).
+
+   The batch functions encrypt the counter blocks of several messages
+   together, so AES-NI has independent blocks to pipeline; a single
+   message is a batch of one.  Nonces are 12 bytes and must never repeat
+   under one key with different contents.
+
+   Everything is static so the header can be included by sr.c and by
+   aeadbench.c without another file to link. */
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__AES__) && defined(__PCLMUL__) && defined(__SSSE3__)
+#define AEAD_HW 1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#else
+#define AEAD_HW 0
+#endif
+
+#define AEADTAG 16        /* bytes of authentication tag */
+#define AEADNONCE 12      /* bytes of nonce */
+#define AEADMAXLEN 112    /* longest message, in bytes */
+#define AEADBATCH 16      /* messages whose blocks are encrypted together */
+
+struct aeadkey {
+  uint8_t rk[11][16];     /* AES-128 round keys */
+  uint8_t h[16];          /* GHASH key, E(0) */
+};
+
+/* one message of a batch */
+struct aeadmsg {
+  const uint8_t *nonce;   /* AEADNONCE bytes */
+  const uint8_t *aad;     /* authenticated, not encrypted */
+  size_t aadlen;
+  const uint8_t *in;      /* plaintext to seal or ciphertext to open */
+  uint8_t *out;           /* may be the same as in */
+  size_t len;             /* at most AEADMAXLEN */
+  uint8_t *tag;           /* written by seal, checked by open */
+  int ok;                 /* open: the tag matched and out holds the plaintext */
+};
+
+/********************* AES-128 ************/
+
+#if !AEAD_HW
+static const uint8_t aead_sbox[256] = {
+  0x63,0x7c,0x77,0x7b,0xf2,0x6b,0x6f,0xc5,0x30,0x01,0x67,0x2b,0xfe,0xd7,0xab,0x76,
+  0xca,0x82,0xc9,0x7d,0xfa,0x59,0x47,0xf0,0xad,0xd4,0xa2,0xaf,0x9c,0xa4,0x72,0xc0,
+  0xb7,0xfd,0x93,0x26,0x36,0x3f,0xf7,0xcc,0x34,0xa5,0xe5,0xf1,0x71,0xd8,0x31,0x15,
+  0x04,0xc7,0x23,0xc3,0x18,0x96,0x05,0x9a,0x07,0x12,0x80,0xe2,0xeb,0x27,0xb2,0x75,
+  0x09,0x83,0x2c,0x1a,0x1b,0x6e,0x5a,0xa0,0x52,0x3b,0xd6,0xb3,0x29,0xe3,0x2f,0x84,
+  0x53,0xd1,0x00,0xed,0x20,0xfc,0xb1,0x5b,0x6a,0xcb,0xbe,0x39,0x4a,0x4c,0x58,0xcf,
+  0xd0,0xef,0xaa,0xfb,0x43,0x4d,0x33,0x85,0x45,0xf9,0x02,0x7f,0x50,0x3c,0x9f,0xa8,
+  0x51,0xa3,0x40,0x8f,0x92,0x9d,0x38,0xf5,0xbc,0xb6,0xda,0x21,0x10,0xff,0xf3,0xd2,
+  0xcd,0x0c,0x13,0xec,0x5f,0x97,0x44,0x17,0xc4,0xa7,0x7e,0x3d,0x64,0x5d,0x19,0x73,
+  0x60,0x81,0x4f,0xdc,0x22,0x2a,0x90,0x88,0x46,0xee,0xb8,0x14,0xde,0x5e,0x0b,0xdb,
+  0xe0,0x32,0x3a,0x0a,0x49,0x06,0x24,0x5c,0xc2,0xd3,0xac,0x62,0x91,0x95,0xe4,0x79,
+  0xe7,0xc8,0x37,0x6d,0x8d,0xd5,0x4e,0xa9,0x6c,0x56,0xf4,0xea,0x65,0x7a,0xae,0x08,
+  0xba,0x78,0x25,0x2e,0x1c,0xa6,0xb4,0xc6,0xe8,0xdd,0x74,0x1f,0x4b,0xbd,0x8b,0x8a,
+  0x70,0x3e,0xb5,0x66,0x48,0x03,0xf6,0x0e,0x61,0x35,0x57,0xb9,0x86,0xc1,0x1d,0x9e,
+  0xe1,0xf8,0x98,0x11,0x69,0xd9,0x8e,0x94,0x9b,0x1e,0x87,0xe9,0xce,0x55,0x28,0xdf,
+  0x8c,0xa1,0x89,0x0d,0xbf,0xe6,0x42,0x68,0x41,0x99,0x2d,0x0f,0xb0,0x54,0xbb,0x16
+};
+
+static uint8_t AeadXtime(uint8_t x)
+{
+  return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b));
+}
+
+static void AeadEncryptBlock(const struct aeadkey *k, uint8_t b[16])
+{
+  uint8_t t[16];
+  int round, i, c;
+
+  for (i = 0; i < 16; i++)
+    b[i] ^= k->rk[0][i];
+  for (round = 1; round <= 10; round++) {
+    /* SubBytes and ShiftRows: byte (row r, column c) comes from column c + r */
+    for (c = 0; c < 4; c++)
+      for (i = 0; i < 4; i++)
+        t[4 * c + i] = aead_sbox[b[4 * ((c + i) % 4) + i]];
+    if (round < 10)
+      for (c = 0; c < 4; c++) {
+        /* MixColumns */
+        uint8_t *col = &t[4 * c], a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+        col[0] ^= all ^ AeadXtime(a0 ^ a1);
+        col[1] ^= all ^ AeadXtime(a1 ^ a2);
+        col[2] ^= all ^ AeadXtime(a2 ^ a3);
+        col[3] ^= all ^ AeadXtime(a3 ^ a0);
+      }
+    for (i = 0; i < 16; i++)
+      b[i] = t[i] ^ k->rk[round][i];
+  }
+}
+#endif
+
+static void AeadSetKey(struct aeadkey *k, const uint8_t key[16])
+{
+#if AEAD_HW
+  __m128i rk[11];
+
+#define AEAD_EXPAND(i, rcon) do {                                        \
+    __m128i gen = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(rk[i - 1], rcon), 0xff); \
+    __m128i t = rk[i - 1];                                               \
+    t = _mm_xor_si128(t, _mm_slli_si128(t, 4));                          \
+    t = _mm_xor_si128(t, _mm_slli_si128(t, 4));                          \
+    t = _mm_xor_si128(t, _mm_slli_si128(t, 4));                          \
+    rk[i] = _mm_xor_si128(t, gen);                                       \
+  } while (0)
+  int i;
+
+  rk[0] = _mm_loadu_si128((const __m128i *)key);
+  AEAD_EXPAND(1, 0x01); AEAD_EXPAND(2, 0x02); AEAD_EXPAND(3, 0x04); AEAD_EXPAND(4, 0x08);
+  AEAD_EXPAND(5, 0x10); AEAD_EXPAND(6, 0x20); AEAD_EXPAND(7, 0x40); AEAD_EXPAND(8, 0x80);
+  AEAD_EXPAND(9, 0x1b); AEAD_EXPAND(10, 0x36);
+#undef AEAD_EXPAND
+  for (i = 0; i < 11; i++)
+    _mm_storeu_si128((__m128i *)k->rk[i], rk[i]);
+  {
+    __m128i h = _mm_xor_si128(_mm_setzero_si128(), rk[0]);
+    for (i = 1; i < 10; i++)
+      h = _mm_aesenc_si128(h, rk[i]);
+    _mm_storeu_si128((__m128i *)k->h, _mm_aesenclast_si128(h, rk[10]));
+  }
+#else
+  static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+  int i;
+
+  memcpy(k->rk[0], key, 16);
+  for (i = 1; i <= 10; i++) {
+    const uint8_t *p = k->rk[i - 1];
+    uint8_t *r = k->rk[i];
+    int j;
+    r[0] = p[0] ^ aead_sbox[p[13]] ^ rcon[i - 1];
+    r[1] = p[1] ^ aead_sbox[p[14]];
+    r[2] = p[2] ^ aead_sbox[p[15]];
+    r[3] = p[3] ^ aead_sbox[p[12]];
+    for (j = 4; j < 16; j++)
+      r[j] = p[j] ^ r[j - 4];
+  }
+  memset(k->h, 0, 16);
+  AeadEncryptBlock(k, k->h);
+#endif
+}
+
+/* encrypt n blocks in place */
+static void AeadEncryptBlocks(const struct aeadkey *k, uint8_t (*b)[16], int n)
+{
+#if AEAD_HW
+  __m128i x[AEADBATCH * (AEADMAXLEN / 16 + 2)];
+  int i, round;
+
+  for (i = 0; i < n; i++)
+    x[i] = _mm_xor_si128(_mm_loadu_si128((__m128i *)b[i]),
+                         _mm_loadu_si128((const __m128i *)k->rk[0]));
+  /* round by round over all the blocks, so each aesenc has independent work behind it */
+  for (round = 1; round < 10; round++) {
+    __m128i rk = _mm_loadu_si128((const __m128i *)k->rk[round]);
+    for (i = 0; i < n; i++)
+      x[i] = _mm_aesenc_si128(x[i], rk);
+  }
+  for (i = 0; i < n; i++)
+    _mm_storeu_si128((__m128i *)b[i],
+                     _mm_aesenclast_si128(x[i], _mm_loadu_si128((const __m128i *)k->rk[10])));
+#else
+  int i;
+
+  for (i = 0; i < n; i++)
+    AeadEncryptBlock(k, b[i]);
+#endif
+}
+
+/********************* GHASH ************/
+
+static void AeadStore64(uint8_t *p, uint64_t x)
+{
+  int i;
+
+  for (i = 7; i >= 0; i--, x >>= 8)
+    p[i] = (uint8_t)x;
+}
+
+#if AEAD_HW
+static __m128i AeadReverse(__m128i x)
+{
+  return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+/* multiply in GF(2^128), operands byte-reversed (Gueron and Kounavis, Intel) */
+static __m128i AeadGfMul(__m128i a, __m128i b)
+{
+  __m128i t2, t3, t4, t5, t6, t7, t8, t9;
+
+  t3 = _mm_clmulepi64_si128(a, b, 0x00);
+  t4 = _mm_clmulepi64_si128(a, b, 0x10);
+  t5 = _mm_clmulepi64_si128(a, b, 0x01);
+  t6 = _mm_clmulepi64_si128(a, b, 0x11);
+  t4 = _mm_xor_si128(t4, t5);
+  t5 = _mm_slli_si128(t4, 8);
+  t4 = _mm_srli_si128(t4, 8);
+  t3 = _mm_xor_si128(t3, t5);
+  t6 = _mm_xor_si128(t6, t4);
+  /* shift the 256-bit product left by one, GCM's bit order */
+  t7 = _mm_srli_epi32(t3, 31);
+  t8 = _mm_srli_epi32(t6, 31);
+  t3 = _mm_slli_epi32(t3, 1);
+  t6 = _mm_slli_epi32(t6, 1);
+  t9 = _mm_srli_si128(t7, 12);
+  t8 = _mm_slli_si128(t8, 4);
+  t7 = _mm_slli_si128(t7, 4);
+  t3 = _mm_or_si128(t3, t7);
+  t6 = _mm_or_si128(t6, t8);
+  t6 = _mm_or_si128(t6, t9);
+  /* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+  t7 = _mm_slli_epi32(t3, 31);
+  t8 = _mm_slli_epi32(t3, 30);
+  t9 = _mm_slli_epi32(t3, 25);
+  t7 = _mm_xor_si128(t7, t8);
+  t7 = _mm_xor_si128(t7, t9);
+  t8 = _mm_srli_si128(t7, 4);
+  t7 = _mm_slli_si128(t7, 12);
+  t3 = _mm_xor_si128(t3, t7);
+  t2 = _mm_srli_epi32(t3, 1);
+  t4 = _mm_srli_epi32(t3, 2);
+  t5 = _mm_srli_epi32(t3, 7);
+  t2 = _mm_xor_si128(t2, t4);
+  t2 = _mm_xor_si128(t2, t5);
+  t2 = _mm_xor_si128(t2, t8);
+  t3 = _mm_xor_si128(t3, t2);
+  return _mm_xor_si128(t6, t3);
+}
+#else
+static uint64_t AeadLoad64(const uint8_t *p)
+{
+  uint64_t x = 0;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    x = x << 8 | p[i];
+  return x;
+}
+
+/* y = y * h in GF(2^128), bit by bit as in the GCM specification */
+static void AeadGfMul(uint8_t y[16], const uint8_t h[16])
+{
+  uint64_t zh = 0, zl = 0, vh = AeadLoad64(h), vl = AeadLoad64(h + 8);
+  int i;
+
+  for (i = 0; i < 128; i++) {
+    uint64_t lsb = vl & 1;
+    if (y[i / 8] >> (7 - i % 8) & 1) {
+      zh ^= vh;
+      zl ^= vl;
+    }
+    vl = (vl >> 1) | (vh << 63);
+    vh = (vh >> 1) ^ (lsb * ((uint64_t)0xe1 << 56));
+  }
+  AeadStore64(y, zh);
+  AeadStore64(y + 8, zl);
+}
+#endif
+
+/* the GHASH of aad and ciphertext c, with their lengths */
+static void AeadGhash(const struct aeadkey *k, const uint8_t *aad, size_t aadlen,
+                      const uint8_t *c, size_t len, uint8_t out[16])
+{
+  uint8_t block[16];
+  const uint8_t *parts[2];
+  size_t lens[2];
+  size_t off, n;
+  int p;
+#if AEAD_HW
+  __m128i h = AeadReverse(_mm_loadu_si128((const __m128i *)k->h)), y = _mm_setzero_si128();
+#else
+  uint8_t y[16] = { 0 };
+  int i;
+#endif
+
+  parts[0] = aad;
+  parts[1] = c;
+  lens[0] = aadlen;
+  lens[1] = len;
+  for (p = 0; p < 3; p++) {
+    for (off = 0; off < (p < 2 ? lens[p] : 1); off += 16) {
+      if (p < 2) {
+        n = lens[p] - off < 16 ? lens[p] - off : 16;
+        memset(block, 0, 16);
+        memcpy(block, parts[p] + off, n);
+      } else {
+        /* the lengths block, in bits */
+        AeadStore64(block, (uint64_t)aadlen * 8);
+        AeadStore64(block + 8, (uint64_t)len * 8);
+      }
+#if AEAD_HW
+      y = AeadGfMul(_mm_xor_si128(y, AeadReverse(_mm_loadu_si128((__m128i *)block))), h);
+#else
+      for (i = 0; i < 16; i++)
+        y[i] ^= block[i];
+      AeadGfMul(y, k->h);
+#endif
+    }
+  }
+#if AEAD_HW
+  _mm_storeu_si128((__m128i *)out, AeadReverse(y));
+#else
+  memcpy(out, y, 16);
+#endif
+}
+
+/********************* GCM ************/
+
+/* the counter blocks of message m: J0 first (for the tag), then one per 16 bytes */
+static int AeadCounters(const struct aeadmsg *m, uint8_t (*b)[16])
+{
+  int i, n = 1 + (int)((m->len + 15) / 16);
+
+  for (i = 0; i < n; i++) {
+    uint32_t ctr = (uint32_t)i + 1;
+    memcpy(b[i], m->nonce, AEADNONCE);
+    b[i][12] = (uint8_t)(ctr >> 24);
+    b[i][13] = (uint8_t)(ctr >> 16);
+    b[i][14] = (uint8_t)(ctr >> 8);
+    b[i][15] = (uint8_t)ctr;
+  }
+  return n;
+}
+
+/* seal (encrypt) or open (decrypt and check) up to AEADBATCH messages */
+static void AeadBatch(const struct aeadkey *k, struct aeadmsg *m, int n, int seal)
+{
+  uint8_t ks[AEADBATCH * (AEADMAXLEN / 16 + 2)][16];
+  int first[AEADBATCH + 1];
+  int i, total = 0;
+
+  for (i = 0; i < n; i++) {
+    first[i] = total;
+    total += AeadCounters(&m[i], &ks[total]);
+  }
+  AeadEncryptBlocks(k, ks, total);
+
+  for (i = 0; i < n; i++) {
+    const uint8_t *stream = ks[first[i] + 1];   /* keystream, contiguous after E(J0) */
+    uint8_t tag[16], diff = 0;
+    size_t j;
+
+    if (seal) {
+      for (j = 0; j < m[i].len; j++)
+        m[i].out[j] = m[i].in[j] ^ stream[j];
+      AeadGhash(k, m[i].aad, m[i].aadlen, m[i].out, m[i].len, tag);
+      for (j = 0; j < AEADTAG; j++)
+        m[i].tag[j] = tag[j] ^ ks[first[i]][j];
+      m[i].ok = 1;
+    } else {
+      AeadGhash(k, m[i].aad, m[i].aadlen, m[i].in, m[i].len, tag);
+      for (j = 0; j < AEADTAG; j++)
+        diff |= m[i].tag[j] ^ tag[j] ^ ks[first[i]][j];   /* no early exit */
+      m[i].ok = diff == 0;
+      if (m[i].ok)
+        for (j = 0; j < m[i].len; j++)
+          m[i].out[j] = m[i].in[j] ^ stream[j];
+    }
+  }
+}
+
+static void AeadSealBatch(const struct aeadkey *k, struct aeadmsg *m, int n)
+{
+  for (; n > AEADBATCH; n -= AEADBATCH, m += AEADBATCH)
+    AeadBatch(k, m, AEADBATCH, 1);
+  AeadBatch(k, m, n, 1);
+}
+
+/* returns the number of messages whose tag matched; each has m[i].ok set */
+static int AeadOpenBatch(const struct aeadkey *k, struct aeadmsg *m, int n)
+{
+  int i, ok = 0;
+
+  for (i = 0; i < n; i++) {
+    int size = n - i < AEADBATCH ? n - i : AEADBATCH;
+    AeadBatch(k, m + i, size, 0);
+    for (; size > 0; size--, i++)
+      ok += m[i].ok;
+    i--;
+  }
+  return ok;
+}
+
+static void AeadSeal(const struct aeadkey *k, const uint8_t *nonce, const uint8_t *aad,
+                     size_t aadlen, const uint8_t *in, uint8_t *out, size_t len, uint8_t *tag)
+{
+  struct aeadmsg m;
+
+  m.nonce = nonce;
+  m.aad = aad;
+  m.aadlen = aadlen;
+  m.in = in;
+  m.out = out;
+  m.len = len;
+  m.tag = tag;
+  AeadSealBatch(k, &m, 1);   /* a batch of one */
+}
+
+/* returns 1 and writes the plaintext if the tag matches, otherwise 0 */
+static int AeadOpen(const struct aeadkey *k, const uint8_t *nonce, const uint8_t *aad,
+                    size_t aadlen, const uint8_t *in, uint8_t *out, size_t len, uint8_t *tag)
+{
+  struct aeadmsg m;
+
+  m.nonce = nonce;
+  m.aad = aad;
+  m.aadlen = aadlen;
+  m.in = in;
+  m.out = out;
+  m.len = len;
+  m.tag = tag;
+  return AeadOpenBatch(k, &m, 1);
+}
@@ -0,0 +1,205 @@
+/**********************************************************************
+   Benchmark of authenticated encryption (aead.h) against the checksum
+
+   First checks AES-128-GCM against test cases 2 to 4 of the GCM
+   specification.  Then times, per packet of the emulator's size, the
+   plain additive checksum that sr.c computes, AES-GCM sealing
+   and opening one packet at a time, and sealing and opening in batches
+   as a retransmission burst or a run of arrivals would be handled.
+
+   Build and run from the directory holding the emulator sources:
+     gcc -O3 -maes -mpclmul -mssse3 aeadbench.c -o aeadbench
+     ./aeadbench [packets] [batch]
+   Without -maes -mpclmul -mssse3 the portable AES and GHASH are timed.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "aead.h"
+
+#define AADLEN 20         /* header bytes authenticated: seqnum, acknum, flags, stream, streamseq */
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int Hex(const char *s, uint8_t *out)
+{
+  int n = 0;
+
+  for (; s[0] != '\0' && s[1] != '\0'; s += 2) {
+    unsigned int byte;
+    sscanf(s, "%2x", &byte);
+    out[n++] = (uint8_t)byte;
+  }
+  return n;
+}
+
+/* one known-answer test, sealing then opening, and opening a tampered copy */
+static int Known(const char *name, const char *key, const char *nonce, const char *aad,
+                 const char *pt, const char *ct, const char *tag)
+{
+  uint8_t k[16], iv[AEADNONCE], a[64], p[AEADMAXLEN], c[AEADMAXLEN], t[16];
+  uint8_t out[AEADMAXLEN], back[AEADMAXLEN], got[16];
+  struct aeadkey ak;
+  int alen, len, ok;
+
+  Hex(key, k);
+  Hex(nonce, iv);
+  alen = Hex(aad, a);
+  len = Hex(pt, p);
+  Hex(ct, c);
+  Hex(tag, t);
+
+  AeadSetKey(&ak, k);
+  AeadSeal(&ak, iv, a, alen, p, out, len, got);
+  ok = memcmp(out, c, len) == 0 && memcmp(got, t, 16) == 0;
+  ok = ok && AeadOpen(&ak, iv, a, alen, out, back, len, got) && memcmp(back, p, len) == 0;
+  out[0] ^= 1;
+  ok = ok && !AeadOpen(&ak, iv, a, alen, out, back, len, got);
+  printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static int SelfTest(void)
+{
+  static const char *k3 = "feffe9928665731c6d6a8f9467308308";
+  static const char *iv3 = "cafebabefacedbaddecaf888";
+  static const char *p3 =
+    "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+    "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255";
+  static const char *c3 =
+    "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+    "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985";
+  int ok = 1;
+
+  ok &= Known("GCM test case 2", "00000000000000000000000000000000", "000000000000000000000000",
+              "", "00000000000000000000000000000000", "0388dace60b6a392f328c2b971b2fe78",
+              "ab6e47d42cec13bdf53a67b21257bddf");
+  ok &= Known("GCM test case 3", k3, iv3, "", p3, c3, "4d5c2af327cd64a62cf35abd2ba6fab4");
+  {
+    /* test case 4: 60 bytes of test case 3's plaintext, with associated data */
+    char p4[121], c4[121];
+    memcpy(p4, p3, 120);
+    p4[120] = '\0';
+    memcpy(c4, c3, 120);
+    c4[120] = '\0';
+    ok &= Known("GCM test case 4", k3, iv3, "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+                p4, c4, "5bc94fbc3221a5db94fae95ae7121a47");
+  }
+  return ok;
+}
+
+/* the additive checksum of sr.c */
+static int ComputeChecksum(struct pkt packet)
+{
+  int checksum = packet.seqnum + packet.acknum + (packet.flags & ~PKT_ECNMASK)
+                 + packet.stream + packet.streamseq;
+  int i;
+
+  for (i = 0; i < 20; i++)
+    checksum += (int)(packet.payload[i]);
+  return checksum;
+}
+
+static void Header(struct pkt *p, uint8_t aad[AADLEN])
+{
+  int fields[5];
+
+  fields[0] = p->seqnum;
+  fields[1] = p->acknum;
+  fields[2] = p->flags;
+  fields[3] = p->stream;
+  fields[4] = p->streamseq;
+  memcpy(aad, fields, AADLEN);
+}
+
+int main(int argc, char *argv[])
+{
+  int packets = argc > 1 ? atoi(argv[1]) : 1000000;
+  int batch = argc > 2 ? atoi(argv[2]) : 8;
+  static struct pkt pkts[64];
+  static uint8_t aads[64][AADLEN], nonces[64][AEADNONCE], tags[64][16];
+  struct aeadmsg msgs[64];
+  struct aeadkey key;
+  uint8_t raw[16] = "emulator key 128";
+  double start, checksum, single, batched, sealonly;
+  long sum = 0;
+  int i, j, opened = 0;
+
+  printf("AES-GCM with %s\n", AEAD_HW ? "AES-NI and PCLMULQDQ" : "the portable code");
+  if (!SelfTest())
+    return EXIT_FAILURE;
+  if (batch < 1 || batch > 64)
+    batch = 8;
+
+  AeadSetKey(&key, raw);
+  for (i = 0; i < 64; i++) {
+    memset(&pkts[i], 0, sizeof(pkts[i]));
+    pkts[i].seqnum = i;
+    for (j = 0; j < 20; j++)
+      pkts[i].payload[j] = 'a' + (i + j) % 26;
+    Header(&pkts[i], aads[i]);
+    memset(nonces[i], 0, AEADNONCE);
+  }
+
+  start = Seconds();
+  for (i = 0; i < packets; i++) {
+    pkts[i & 63].seqnum = i;
+    sum += ComputeChecksum(pkts[i & 63]);       /* once at the sender */
+    sum += ComputeChecksum(pkts[i & 63]) == sum; /* once at the receiver */
+  }
+  checksum = Seconds() - start;
+
+  /* one packet at a time: seal, then open */
+  start = Seconds();
+  for (i = 0; i < packets; i++) {
+    struct pkt *p = &pkts[i & 63];
+    memcpy(nonces[i & 63], &i, sizeof(i));
+    AeadSeal(&key, nonces[i & 63], aads[i & 63], AADLEN, (uint8_t *)p->payload,
+             (uint8_t *)p->payload, 20, tags[i & 63]);
+    opened += AeadOpen(&key, nonces[i & 63], aads[i & 63], AADLEN, (uint8_t *)p->payload,
+                       (uint8_t *)p->payload, 20, tags[i & 63]);
+  }
+  single = Seconds() - start;
+
+  /* batches: seal a burst, then open it as a run of arrivals */
+  for (j = 0; j < batch; j++) {
+    msgs[j].nonce = nonces[j];
+    msgs[j].aad = aads[j];
+    msgs[j].aadlen = AADLEN;
+    msgs[j].in = msgs[j].out = (uint8_t *)pkts[j].payload;
+    msgs[j].len = 20;
+    msgs[j].tag = tags[j];
+  }
+  sealonly = 0.0;
+  start = Seconds();
+  for (i = 0; i + batch <= packets; i += batch) {
+    double sealed;
+    for (j = 0; j < batch; j++) {
+      int n = i + j;
+      memcpy(nonces[j], &n, sizeof(n));
+    }
+    sealed = Seconds();
+    AeadSealBatch(&key, msgs, batch);
+    sealonly += Seconds() - sealed;
+    opened += AeadOpenBatch(&key, msgs, batch);
+  }
+  batched = Seconds() - start;
+
+  printf("per packet of %d payload bytes, %d packets:\n", 20, packets);
+  printf("  additive checksum, send and check   %8.1f ns\n", checksum / packets * 1e9);
+  printf("  AES-GCM seal and open, one by one   %8.1f ns  (%.1fx the checksum)\n",
+         single / packets * 1e9, single / checksum);
+  printf("  AES-GCM seal and open, batches of %-2d %8.1f ns  (%.2fx one by one)\n",
+         batch, batched / packets * 1e9, single / batched);
+  printf("  (of which sealing                   %8.1f ns)\n", sealonly / packets * 1e9);
+  printf("(%d of %d opened, checksum sum %ld)\n", opened, 2 * packets - packets % batch, sum);
+  return opened == 2 * packets - packets % batch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
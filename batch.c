@@ -0,0 +1,349 @@
+/**********************************************************************
+   Batch simulation of many independent SR flows
+
+   Sweeps run thousands of identical small simulations that differ only
+   in their random numbers.  This engine advances all the flows in
+   lockstep, one time unit per tick, with the state of the flows kept
+   as a structure of arrays (one array per field, indexed by flow), so
+   the work of a tick can be done for many flows at once.
+
+   Each flow is a model of sr.c rather than sr.c itself: a fixed window
+   with selective ACKs and one retransmission timer at A, a receive
+   window at B, and a channel per direction that loses packets and
+   delivers the rest in order, each arrival 1 to 10 time units after
+   the previous one like the emulator's channel.  Messages reach A with
+   probability 1/lambda each tick and are dropped when the window is
+   full.  A corrupted packet is treated as lost.
+
+   Most ticks are quiet for most flows.  With AVX2 a tick advances the
+   random number generators of eight flows at once, decides which of
+   them get a new message, and compares their timers and the heads of
+   their channels with the clock; only the flows with something to do
+   then run the (scalar) transitions.  The same flows are also run
+   one at a time and in lockstep without AVX2, and all three must give
+   the same results, since each flow draws its own random numbers in
+   the same order.
+
+   Build and run:
+     gcc -O2 -mavx2 batch.c -o batch
+     ./batch [flows] [messages per flow] [loss] [corruption] [lambda]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define MAXFLOWS 65536    /* largest batch */
+#define WINDOWSIZE 6      /* sender window, at most 32 */
+#define RTT 16.0f         /* retransmission timeout */
+#define CAPACITY 32       /* packets each direction of a flow's channel can hold, a power of 2 */
+#define MAXTICKS 1000000  /* give up on flows that have not finished by then */
+#define NEVER 1e30f       /* timer off, channel empty */
+
+/* per-flow state, one array per field */
+static uint32_t rng[MAXFLOWS];          /* xorshift32 state */
+static int msgsleft[MAXFLOWS];          /* messages still to reach A */
+static int base[MAXFLOWS];              /* oldest unACKed packet */
+static int nextseq[MAXFLOWS];           /* next packet to send */
+static uint32_t acked[MAXFLOWS];        /* bit i: packet base+i ACKed */
+static float timer[MAXFLOWS];           /* time A's timer goes off, or NEVER */
+static int expected[MAXFLOWS];          /* next packet B delivers */
+static uint32_t received[MAXFLOWS];     /* bit i: packet expected+i buffered at B */
+static int delivered[MAXFLOWS];
+static int resent[MAXFLOWS];
+static int dropped[MAXFLOWS];           /* messages refused because the window was full */
+static float finish[MAXFLOWS];          /* time of the last delivery */
+static long events[MAXFLOWS];           /* messages, packet arrivals and timeouts handled */
+
+/* the channel of each direction: a ring of packets per flow.  headtime caches the arrival
+   time of the packet at the head so the tick can test it without touching the ring. */
+struct channel {
+  int seq[MAXFLOWS][CAPACITY];
+  float time[MAXFLOWS][CAPACITY];
+  int head[MAXFLOWS];
+  int count[MAXFLOWS];
+  float last[MAXFLOWS];                 /* arrival time of the last packet put on the channel */
+  float headtime[MAXFLOWS];
+};
+static struct channel tob, toa;
+
+static int nflows, nmessages;
+static float lossprob, msgprob;
+
+/********************* the model of one flow ************/
+
+static uint32_t Rand(int f)
+{
+  uint32_t x = rng[f];
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return rng[f] = x;
+}
+
+/* uniform in [0, 1) from the top 24 bits */
+static float Uniform(uint32_t x)
+{
+  return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+static void Send(struct channel *ch, int f, int seq, float now)
+{
+  float arrival;
+  int slot;
+
+  if (Uniform(Rand(f)) < lossprob || ch->count[f] == CAPACITY)
+    return;
+  arrival = (ch->last[f] > now ? ch->last[f] : now) + 1.0f + 9.0f * Uniform(Rand(f));
+  ch->last[f] = arrival;
+  slot = (ch->head[f] + ch->count[f]++) % CAPACITY;
+  ch->seq[f][slot] = seq;
+  ch->time[f][slot] = arrival;
+  if (ch->count[f] == 1)
+    ch->headtime[f] = arrival;
+}
+
+static int Receive(struct channel *ch, int f)
+{
+  int seq = ch->seq[f][ch->head[f]];
+
+  ch->head[f] = (ch->head[f] + 1) % CAPACITY;
+  ch->headtime[f] = --ch->count[f] > 0 ? ch->time[f][ch->head[f]] : NEVER;
+  return seq;
+}
+
+/* everything that happens to flow f at tick 'now'; newmsg if a message reaches A */
+static void Step(int f, float now, int newmsg)
+{
+  int i;
+
+  while (toa.headtime[f] <= now) {
+    /* an ACK reaches A */
+    int offset = Receive(&toa, f) - base[f];
+    events[f]++;
+    if (offset >= 0 && offset < nextseq[f] - base[f] && !(acked[f] >> offset & 1)) {
+      acked[f] |= 1u << offset;
+      while ((acked[f] & 1) && base[f] != nextseq[f]) {
+        acked[f] >>= 1;
+        base[f]++;
+      }
+      timer[f] = base[f] == nextseq[f] ? NEVER : now + RTT;
+    }
+  }
+
+  while (tob.headtime[f] <= now) {
+    /* a packet reaches B, which ACKs it whether new or not */
+    int seq = Receive(&tob, f);
+    int offset = seq - expected[f];
+    events[f]++;
+    if (offset >= 0 && offset < WINDOWSIZE) {
+      received[f] |= 1u << offset;
+      while (received[f] & 1) {
+        received[f] >>= 1;
+        expected[f]++;
+        delivered[f]++;
+        finish[f] = now;
+      }
+    }
+    Send(&toa, f, seq, now);
+  }
+
+  if (timer[f] <= now) {
+    events[f]++;
+    for (i = 0; i < nextseq[f] - base[f]; i++)
+      if (!(acked[f] >> i & 1)) {
+        Send(&tob, f, base[f] + i, now);
+        resent[f]++;
+      }
+    timer[f] = now + RTT;
+  }
+
+  if (newmsg) {
+    events[f]++;
+    msgsleft[f]--;
+    if (nextseq[f] - base[f] < WINDOWSIZE) {
+      Send(&tob, f, nextseq[f]++, now);
+      if (timer[f] == NEVER)
+        timer[f] = now + RTT;
+    } else
+      dropped[f]++;
+  }
+}
+
+static int Done(int f)
+{
+  return msgsleft[f] == 0 && base[f] == nextseq[f] && tob.count[f] == 0 && toa.count[f] == 0;
+}
+
+/* one tick of flow f without vectors: draw whether a message arrives, then step */
+static int Tick(int f, float now)
+{
+  int newmsg = Uniform(Rand(f)) < msgprob && msgsleft[f] > 0;
+
+  if (newmsg || timer[f] <= now || tob.headtime[f] <= now || toa.headtime[f] <= now)
+    Step(f, now, newmsg);
+  return !Done(f);
+}
+
+/********************* the three ways of running the batch ************/
+
+static void Reset(void)
+{
+  int f;
+
+  for (f = 0; f < nflows; f++) {
+    rng[f] = 2463534242u + 977u * f;    /* any nonzero seed, distinct per flow */
+    msgsleft[f] = nmessages;
+    base[f] = nextseq[f] = expected[f] = 0;
+    acked[f] = received[f] = 0;
+    timer[f] = NEVER;
+    delivered[f] = resent[f] = dropped[f] = 0;
+    finish[f] = 0.0f;
+    events[f] = 0;
+    tob.head[f] = tob.count[f] = toa.head[f] = toa.count[f] = 0;
+    tob.last[f] = toa.last[f] = 0.0f;
+    tob.headtime[f] = toa.headtime[f] = NEVER;
+  }
+}
+
+/* each flow from start to finish before the next */
+static void OneAtATime(void)
+{
+  int f, tick;
+
+  for (f = 0; f < nflows; f++)
+    for (tick = 1; tick <= MAXTICKS && Tick(f, (float)tick); tick++)
+      ;
+}
+
+/* all flows advance one tick at a time */
+static void Lockstep(void)
+{
+  int f, tick, running = 1;
+
+  for (tick = 1; tick <= MAXTICKS && running; tick++) {
+    running = 0;
+    for (f = 0; f < nflows; f++)
+      running |= Tick(f, (float)tick);
+  }
+}
+
+#ifdef __AVX2__
+/* lockstep, testing eight flows per instruction and stepping only those with an event */
+static void LockstepAVX2(void)
+{
+  const __m256 scale = _mm256_set1_ps(1.0f / 16777216.0f);
+  const __m256 prob = _mm256_set1_ps(msgprob);
+  int f, tick, running = 1;
+
+  for (tick = 1; tick <= MAXTICKS && running; tick++) {
+    const __m256 now = _mm256_set1_ps((float)tick);
+    running = 0;
+    for (f = 0; f < nflows; f += 8) {
+      __m256i x = _mm256_loadu_si256((__m256i *)&rng[f]);
+      __m256 u, busy;
+      __m256i left;
+      int newmsg, mask;
+
+      x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+      x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+      x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+      _mm256_storeu_si256((__m256i *)&rng[f], x);
+      u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), scale);
+
+      left = _mm256_cmpgt_epi32(_mm256_loadu_si256((__m256i *)&msgsleft[f]), _mm256_setzero_si256());
+      newmsg = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(u, prob, _CMP_LT_OQ),
+                                                _mm256_castsi256_ps(left)));
+      busy = _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&timer[f]), now, _CMP_LE_OQ),
+             _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&tob.headtime[f]), now, _CMP_LE_OQ),
+                          _mm256_cmp_ps(_mm256_loadu_ps(&toa.headtime[f]), now, _CMP_LE_OQ)));
+      mask = newmsg | _mm256_movemask_ps(busy);
+
+      while (mask) {
+        int lane = __builtin_ctz(mask);
+        Step(f + lane, (float)tick, newmsg >> lane & 1);
+        mask &= mask - 1;
+      }
+      /* a flow is running while it has messages to come, packets unACKed or in flight */
+      if (!running)
+        for (mask = 0; mask < 8 && !running; mask++)
+          running = !Done(f + mask);
+    }
+  }
+}
+#endif
+
+/********************* the driver ************/
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* run the batch one way, print the rate and return a digest of the results */
+static uint64_t Run(void (*engine)(void), const char *name)
+{
+  uint64_t digest = 1469598103934665603ull;
+  long total = 0, sumdelivered = 0, sumresent = 0, sumdropped = 0;
+  double start, elapsed, sumgoodput = 0.0;
+  int f;
+
+  Reset();
+  start = Seconds();
+  engine();
+  elapsed = Seconds() - start;
+
+  for (f = 0; f < nflows; f++) {
+    total += events[f];
+    sumdelivered += delivered[f];
+    sumresent += resent[f];
+    sumdropped += dropped[f];
+    if (finish[f] > 0.0f)
+      sumgoodput += delivered[f] / finish[f];
+    digest = (digest ^ (uint64_t)delivered[f]) * 1099511628211ull;
+    digest = (digest ^ (uint64_t)resent[f]) * 1099511628211ull;
+    digest = (digest ^ (uint64_t)(finish[f] * 16.0f)) * 1099511628211ull;
+  }
+  printf("%-14s %8.3f s  %12.0f events/s  (%ld events; per flow: %.1f delivered, %.1f resent, "
+         "%.1f dropped, goodput %f)\n",
+         name, elapsed, total / elapsed, total, (double)sumdelivered / nflows,
+         (double)sumresent / nflows, (double)sumdropped / nflows, sumgoodput / nflows);
+  return digest;
+}
+
+int main(int argc, char *argv[])
+{
+  float corruptprob;
+  uint64_t reference;
+  int same = 1;
+
+  nflows = argc > 1 ? atoi(argv[1]) : 4096;
+  nmessages = argc > 2 ? atoi(argv[2]) : 1000;
+  lossprob = argc > 3 ? atof(argv[3]) : 0.1;
+  corruptprob = argc > 4 ? atof(argv[4]) : 0.1;
+  msgprob = 1.0f / (argc > 5 ? atof(argv[5]) : 20.0);
+  if (nflows < 8 || nflows > MAXFLOWS || nflows % 8 != 0) {
+    printf("the number of flows must be a multiple of 8 up to %d\n", MAXFLOWS);
+    return EXIT_FAILURE;
+  }
+  lossprob = 1.0f - (1.0f - lossprob) * (1.0f - corruptprob);
+
+  printf("%d flows of %d messages, window %d, timeout %.1f\n", nflows, nmessages, WINDOWSIZE, RTT);
+  reference = Run(OneAtATime, "one at a time");
+  same &= Run(Lockstep, "lockstep") == reference;
+#ifdef __AVX2__
+  same &= Run(LockstepAVX2, "lockstep AVX2") == reference;
+#else
+  printf("built without AVX2 (-mavx2), vector engine skipped\n");
+#endif
+  printf(same ? "all engines agree\n" : "ENGINES DISAGREE\n");
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,248 @@
+/**********************************************************************
+   Microbenchmark for the protocol handlers of sr.c or gbn.c
+
+   Links a protocol against stub layer 3 / layer 5 / timer routines in
+   place of the emulator, so the time measured is spent in the
+   handlers rather than in the event list.  A synthetic packet stream
+   drives A_output(), B_input(), A_input() and A_timerinterrupt() for
+   three patterns:
+     in-order    every packet arrives, in the order sent
+     lossy       one in LOSSEVERY data packets is dropped and A times out
+                 whenever its window is full
+     reordered   data packets arrive with each pair swapped
+     zero-copy   in-order, with the messages handed to A_output_zc() from
+                 buffers the application fills beforehand
+   and the cost is reported in ns per handler call and per message
+   delivered.
+
+   Build with either protocol:
+     gcc -O2 bench.c sr.c -o bench_sr
+     gcc -O2 bench.c gbn.c -o bench_gbn
+     ./bench_sr [messages]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "sr.h"
+
+#define MESSAGES 1000000  /* messages offered to A per pattern, unless given */
+#define LOSSEVERY 10      /* lossy pattern: drop one data packet in this many */
+#define QUEUESIZE 4096    /* packets in flight between the stubs */
+#define BURST 2           /* messages A sends before the channel delivers, so packets can overtake */
+
+#define INORDER   0
+#define LOSSY     1
+#define REORDERED 2
+#define ZEROCOPY  3
+
+/* statistics the protocols update, normally defined by the emulator */
+int TRACE = 0;
+int total_ACKs_received;
+int packets_resent;
+int new_ACKs;
+int packets_received;
+int window_full;
+int tlp_probes;
+int messages_abandoned;
+int messages_skipped;
+int window_reductions;
+int packets_repaired;
+int repairs_new;
+int packets_cached;
+int naks_sent;
+int naks_aggregated;
+int bulk_messages;
+int bulk_packets;
+int bulk_bytes;
+double bulk_cpu;
+int rtt_samples;
+int rtt_histogram[RTTBINS];
+
+static float now;              /* fake clock, one time unit per message */
+static int delivered;          /* messages passed to layer 5 */
+static int calls;              /* handler calls made */
+
+/* packets on their way to each entity */
+static struct pkt queue[2][QUEUESIZE];
+static int head[2], tail[2];
+
+/* zero-copy pattern: the application's message buffers, more than A can hold at once */
+static struct msg buffers[QUEUESIZE];
+static int released;           /* buffers A handed back */
+
+/********************* stubs for the emulator routines ************/
+
+/* the next free place in the queue toward entity to */
+static struct pkt *Slot(int to)
+{
+  if (tail[to] - head[to] == QUEUESIZE) {
+    printf("bench: more than %d packets in flight\n", QUEUESIZE);
+    exit(EXIT_FAILURE);
+  }
+  return &queue[to][tail[to]++ % QUEUESIZE];
+}
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  int to = (AorB + 1) % 2;
+
+  *Slot(to) = packet;
+}
+
+void tolayer3_zc(int AorB, const struct pkt *header, const char payload[20])
+{
+  struct pkt *packet = Slot((AorB + 1) % 2);
+
+  *packet = *header;
+  memcpy(packet->payload, payload, sizeof(packet->payload));
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  (void)AorB;
+  (void)datasent;
+  delivered++;
+}
+
+void starttimer(int AorB, double increment)
+{
+  (void)AorB;
+  (void)increment;
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+}
+
+float currenttime(void)
+{
+  return now;
+}
+
+void record_rtt(float sample)
+{
+  (void)sample;
+  rtt_samples++;
+}
+
+void record_latency(int stream, float latency)
+{
+  (void)stream;
+  (void)latency;
+}
+
+void record_reorder(float wait)
+{
+  (void)wait;
+}
+
+/********************* the driver ************/
+
+static void Released(struct msg *message)
+{
+  (void)message;
+  released++;
+}
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* deliver the data packets waiting for B according to the pattern, then the ACKs for A */
+static void Deliver(int pattern, int *sent)
+{
+  struct pkt held;
+  int holding = 0;
+
+  while (head[B] != tail[B]) {
+    struct pkt packet = queue[B][head[B]++ % QUEUESIZE];
+
+    (*sent)++;
+    if (pattern == LOSSY && *sent % LOSSEVERY == 0)
+      continue;
+    if (pattern == REORDERED && !holding && head[B] != tail[B]) {
+      held = packet;            /* let the next packet overtake this one */
+      holding = 1;
+      continue;
+    }
+    B_input(packet);
+    calls++;
+    if (holding) {
+      B_input(held);
+      calls++;
+      holding = 0;
+    }
+  }
+  if (holding) {
+    B_input(held);
+    calls++;
+  }
+  while (head[A] != tail[A]) {
+    A_input(queue[A][head[A]++ % QUEUESIZE]);
+    calls++;
+  }
+}
+
+static void Run(int pattern, const char *name, int messages)
+{
+  struct msg message;
+  double start, elapsed;
+  int i, refused, sent = 0;
+
+  for (i = 0; i < 20; i++)
+    message.data[i] = 'a';
+  message.lifetime = 0.0;
+  message.stream = 0;
+  for (i = 0; i < QUEUESIZE; i++)
+    buffers[i] = message;
+  released = 0;
+  head[A] = tail[A] = head[B] = tail[B] = 0;
+  now = 0.0;
+  delivered = 0;
+  calls = 0;
+  window_full = 0;
+  A_init();
+  B_init();
+
+  start = Seconds();
+  for (i = 0; i < messages; i++) {
+    now += 1.0;
+    refused = window_full;
+    if (pattern == ZEROCOPY)
+      A_output_zc(&buffers[i % QUEUESIZE], Released);
+    else
+      A_output(message);
+    calls++;
+    if (window_full != refused) {
+      /* the window is full: treat it as a timeout */
+      A_timerinterrupt();
+      calls++;
+    }
+    if (i % BURST == BURST - 1)
+      Deliver(pattern, &sent);
+  }
+  Deliver(pattern, &sent);
+  elapsed = Seconds() - start;
+
+  printf("%-10s  %8.1f ns/call  %8.1f ns/message delivered  (%d calls, %d delivered)\n",
+         name, elapsed * 1e9 / calls, delivered ? elapsed * 1e9 / delivered : 0.0,
+         calls, delivered);
+}
+
+int main(int argc, char *argv[])
+{
+  int messages = argc > 1 ? atoi(argv[1]) : MESSAGES;
+
+  Run(INORDER, "in-order", messages);
+  Run(LOSSY, "lossy", messages);
+  Run(REORDERED, "reordered", messages);
+  Run(ZEROCOPY, "zero-copy", messages);
+  return EXIT_SUCCESS;
+}
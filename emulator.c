@@ -1,11 +1,12 @@
-/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
-   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-   the emulator, you're welcome to look at the code - but again, you should have
-   to, and you defeinitely should not have to modify
+/* ***** THE NETWORK EMULATOR *****************************************
+   Students do not need to read this file, and protocol code must not
+   reference its data structures: everything a protocol may use is
+   declared in emulator.h.  The file has grown well past the original
+   assignment's channel (see "Extensions" below); it is changed like any
+   other part of the tree, but the defaults of its knobs reproduce the
+   original emulator, so the assignment's behaviour is unchanged.
    This file contains the code that emulates the network.  It does not
-   implement any of the Go-Back-N protocol.
+   implement any of the protocols.
    ********************************************************************
 
    ******************************************************************
@@ -33,10 +34,31 @@
    soon as n packets are sent.
    - fixed C style to adhere to current programming style
 
+   Extensions, each off by default and set by the #define knobs below:
+   - several paths with their own impairments (NPATHS), and paths made of
+     NHOPS links with store-and-forward relays, optionally resending lost
+     packets link by link (HOPARQ); packets on different paths can overtake
+     each other
+   - multicast to NRECEIVERS receivers, one copy of each packet per receiver
+   - asymmetric loss, corruption, propagation delay and bandwidth per
+     direction, and per-direction delay models (constant, normal,
+     log-normal, Pareto or an empirical CDF)
+   - ECN marking once a queue builds up, and cross traffic sharing the first
+     link (constant rate, Poisson or on/off)
+   - scenario files that change the channel at given times
+   - message lifetimes, and zero-copy sends to A from a pool of message
+     buffers (ZEROCOPY, see tolayer3_zc())
+   - the statistics, latency and RTT histograms printed at the end
+   Link with -lm when the cross-traffic generator or delay model 2, 3 or 4
+   is on.
+
    ********************************************************************* */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include "emulator.h"
+#include "rng.h"
 #include "gbn.h"
 
 struct event {
@@ -44,6 +66,8 @@ struct event {
   int evtype;             /* event type code */
   int eventity;           /* entity where event occurs */
   struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  int hop;                /* links the packet has crossed before this one */
+  int cross;              /* the packet is cross traffic, dropped when it leaves its link */
   struct event *prev;
   struct event *next;
 };
@@ -54,10 +78,110 @@ struct event *evlist = NULL;   /* the event list */
 #define  TIMER_INTERRUPT 0  
 #define  FROM_LAYER5     1
 #define  FROM_LAYER3     2
+#define  CROSS_TRAFFIC   3
+#define  SCENARIO_EVENT  4    /* eventity holds the index of the scenario line */
 
 #define  OFF             0
 #define  ON              1
 
+/* synthetic cross traffic sharing the first link toward CROSSDIRECTION.  Its packets
+   queue with the protocol's packets and are dropped when they leave the link. */
+#define  CROSSTRAFFIC  0      /* 0 = none, 1 = constant bit rate, 2 = Poisson,
+                                 3 = on/off bursts sent at the constant rate */
+#define  CROSSINTERVAL 20.0   /* mean time between cross-traffic packets */
+#define  CROSSON       100.0  /* on/off: mean length of a burst */
+#define  CROSSOFF      100.0  /* on/off: mean time between bursts */
+#define  CROSSDIRECTION B     /* entity the cross traffic flows toward */
+
+/* scenario file of scheduled changes to the channel, "" = none.  One change per line,
+   lines starting with # are comments:
+     <time> down             all packets put on the channel are lost until "up"
+     <time> up
+     <time> loss <prob>      new loss probability
+     <time> corrupt <prob>   new corruption probability
+     <time> lambda <mean>    new average time between messages from layer 5
+     <time> rate <factor>    multiply the message arrival rate by factor */
+#define  SCENARIOFILE  ""
+#define  MAXSCENARIO   32
+
+#define  MSGLIFETIME   0.0  /* lifetime given to each generated message, 0.0 = fully reliable */
+#define  ZEROCOPY      0    /* 1 = hand messages to A with A_output_zc() from a pool of buffers
+                               A gives back when done, 0 = pass copies to A_output() */
+#define  ZCPOOL        64   /* zero-copy message buffers */
+#define  ECNTHRESHOLD  0    /* mark ECN-capable packets once this many packets are queued
+                               toward the receiver, 0 = never mark */
+
+/* impairments of each path, of which the first NPATHS are used.  Path 0 is the
+   original channel.  A packet arrives mindelay plus up to spread time units after the
+   previous packet on its path, so a path carries about one packet per
+   mindelay + spread/2 time units.  The loss and corruption probabilities entered
+   at startup are scaled per path. */
+#define  MAXPATHS      4
+struct path {
+  float mindelay;      /* least time after the previous arrival on the path */
+  float spread;        /* plus a uniform random delay of up to this much */
+  float lossscale;     /* multiplies the loss probability */
+  float corruptscale;  /* multiplies the corruption probability */
+};
+static const struct path paths[MAXPATHS] = {
+  { 1.0, 9.0, 1.0, 1.0 },   /* the original channel */
+  { 4.0, 4.0, 0.5, 0.5 },   /* slower but cleaner */
+  { 0.5, 3.0, 2.0, 1.0 },   /* faster but lossier */
+  { 8.0, 8.0, 0.0, 0.0 },   /* slow and clean */
+};
+#if NPATHS > MAXPATHS
+#error "NPATHS is larger than the paths[] table"
+#endif
+
+/* independent channel parameters for each direction.  With ASYMMETRIC set, the loss
+   and corruption probabilities entered first apply to A->B, and init() asks for
+   those of B->A instead of a direction.  A packet takes at least the propagation
+   delay of its direction; BANDWIDTH divides the time between packets on a link,
+   2.0 carries twice the packets of the original channel. */
+#define  ASYMMETRIC    0
+#define  PROPDELAY_AB  0.0
+#define  PROPDELAY_BA  0.0
+#define  BANDWIDTH_AB  1.0
+#define  BANDWIDTH_BA  1.0
+
+/* how long each packet takes after the previous one on its link, per direction:
+   0 = uniform over the path's [mindelay, mindelay + spread] (the original channel),
+   1 = constant, 2 = normal, 3 = log-normal, 4 = Pareto, 5 = empirical CDF from DELAYCDFFILE.
+   Models 1-5 have mean DELAYMEAN on path 0 and are scaled to the other paths' means. */
+#define  DELAYMODEL_AB 0      /* A->B */
+#define  DELAYMODEL_BA 0      /* B->A */
+#define  DELAYMEAN     5.5
+#define  DELAYSTDDEV   2.5    /* normal and log-normal */
+#define  PARETOSHAPE   1.5    /* Pareto tail index, heavier tails as it nears 1 */
+#define  DELAYMIN      0.01   /* shortest delay drawn, a link must not reorder */
+#define  DELAYCDFFILE  "delaycdf.txt"  /* lines of "<delay> <cumulative probability>",
+                                          both increasing, the last probability 1 */
+#define  DELAYLIBM     ((DELAYMODEL_AB >= 2 && DELAYMODEL_AB <= 4) \
+                        || (DELAYMODEL_BA >= 2 && DELAYMODEL_BA <= 4))  /* models that need libm */
+#define  MAXCDFPOINTS  64
+
+/* every path is a chain of NHOPS links with a store-and-forward relay between
+   consecutive links.  A link scales the delay, loss and corruption of its path. */
+#define  NHOPS         1    /* links between A and B, 1 = direct */
+#define  HOPARQ        0    /* 1 = each link resends its own lost and corrupted packets
+                               (hop-by-hop ARQ) under the end-to-end protocol */
+#define  HOPRTO        12.0 /* time a link waits before resending */
+#define  MAXHOPS       4
+struct link {
+  float delayscale;    /* multiplies the delay of the path */
+  float lossscale;     /* multiplies the loss probability of the path */
+  float corruptscale;  /* multiplies the corruption probability of the path */
+};
+static const struct link links[MAXHOPS] = {
+  { 1.0, 1.0, 1.0 },
+  { 1.0, 1.0, 1.0 },
+  { 1.0, 1.0, 1.0 },
+  { 1.0, 1.0, 1.0 },
+};
+#if NHOPS > MAXHOPS
+#error "NHOPS is larger than the links[] table"
+#endif
+
 int TRACE = 3;
 
 /* statistics updated by GBN */
@@ -66,6 +190,24 @@ int total_ACKs_received;
 int packets_resent;       /* count of the number of packets resent  */
 int new_ACKs;           /* count of the number of acks correctly received */
 int packets_received;  /* count of the packets received by receiver */
+int tlp_probes;        /* count of the tail loss probes sent */
+int messages_abandoned; /* count of messages abandoned by the sender */
+int messages_skipped;   /* count of sequence numbers skipped by the receiver */
+int window_reductions;  /* count of congestion window reductions by the sender */
+int packets_repaired;   /* count of packets rebuilt by the receiver from corrupted copies */
+int repairs_new;        /* count of rebuilt packets not yet received intact */
+int packets_cached;     /* count of out-of-order packets held by the GBN receiver */
+int naks_sent;          /* count of NAKs sent by the multicast receivers */
+int naks_aggregated;    /* count of NAKs answered by an earlier resend */
+int bulk_messages;      /* count of messages sent in compressed packets */
+int bulk_packets;       /* count of compressed packets sent */
+int bulk_bytes;         /* payload bytes of the compressed data */
+double bulk_cpu;        /* CPU seconds spent compressing and decompressing */
+int rtt_samples;       /* number of RTT samples taken from echoed timestamps */
+int rtt_histogram[RTTBINS];
+static float rtt_total;    /* sum of all RTT samples */
+static float rtt_min;      /* smallest RTT sample */
+static float rtt_max;      /* largest RTT sample */
 
 /* statistics updated by emulator */
 static int packets_lost;  
@@ -73,6 +215,53 @@ static int packets_corrupt;
 static int packets_sent;
 static int packets_timeout;
 static int messages_delivered;
+static int packets_marked;      /* packets marked with congestion experienced */
+static float lastdelivery;      /* time the last message was delivered to layer 5 */
+static int latency_samples[NSTREAMS];  /* number of delivered messages with a recorded latency */
+static float latency_total[NSTREAMS];  /* sum of the latencies of delivered messages */
+static float latency_max[NSTREAMS];    /* largest latency of a delivered message */
+static int latency_histogram[NSTREAMS][LATENCYBINS]; /* last bin also counts latencies beyond the range */
+static int path_sent[NPATHS];     /* packets handed to each path */
+static int path_lost[NPATHS];     /* packets lost on each path */
+static int link_lost[NHOPS];      /* packets lost on each link of the chain */
+static int link_resends;          /* resends by hop-by-hop ARQ */
+static int cross_sent;            /* cross-traffic packets put on the channel */
+static float cross_onend;         /* on/off: time the current burst ends */
+static int receiving;             /* multicast receiver the packet given to B_input() is for */
+static int receiver_delivered[NRECEIVERS];    /* messages delivered by each receiver */
+static float receiver_lastdelivery[NRECEIVERS]; /* time of each receiver's last delivery */
+
+/* scenario changes and how the protocol recovered after each one */
+#define  SC_DOWN    0
+#define  SC_UP      1
+#define  SC_LOSS    2
+#define  SC_CORRUPT 3
+#define  SC_LAMBDA  4
+#define  SC_RATE    5
+struct change {
+  float time;
+  int action;             /* SC_ code */
+  float value;
+  float firstdelivery;    /* time of the first delivery to layer 5 after the change, 0.0 = none yet */
+  int delivered;          /* messages delivered to layer 5 when the change happened */
+};
+static struct change scenario[MAXSCENARIO];
+static int nscenario;             /* number of changes loaded */
+static int scenario_done;         /* number of changes that have happened */
+static int link_down;             /* all packets put on the channel are lost */
+static int packets_outage;        /* packets lost while the link was down */
+
+static float cdf_delay[MAXCDFPOINTS];  /* empirical delay distribution */
+static float cdf_prob[MAXCDFPOINTS];
+static int ncdfpoints;
+static int reorder_samples;       /* packets that waited in the receiver's reorder buffer */
+static float reorder_total;       /* total time they waited */
+static float reorder_max;         /* longest wait */
+
+static struct msg zc_pool[ZCPOOL];  /* zero-copy message buffers */
+static int zc_free[ZCPOOL];       /* stack of the indices of the free buffers */
+static int zc_nfree;
+static int zc_maxheld;            /* most buffers A held at once */
 
 static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
 static int nsimmax = 0;           /* number of msgs to generate, then stop */
@@ -80,10 +269,23 @@ static float time = 0.000;
 static float lossprob;            /* probability that a packet is dropped  */
 static float corruptprob;   /* probability that one bit is packet is flipped */
 static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
+static float lossprob_ba;         /* ASYMMETRIC: probability that a packet to A is dropped */
+static float corruptprob_ba;      /* ASYMMETRIC: probability that a packet to A is corrupted */
 static float lambda;        /* arrival rate of messages from layer 5 */   
 static int   ntolayer3;           /* number sent into layer 3 */
+static long  nevents;             /* events taken off the event list */
 static int   nlost;               /* number lost in media */
 static int ncorrupt;              /* number corrupted by media*/
+static int dir_lost[2];           /* lost in media, by destination */
+static int dir_corrupt[2];        /* corrupted by media, by destination */
+
+/* 1 = jimsrand() hands out numbers from blocks filled by the vectorised generator in
+   rng.h instead of calling rand() each time.  The runs differ from those with rand().
+   May be given on the compiler command line (-D), rngbench does. */
+#ifndef FASTRAND
+#define FASTRAND 0
+#endif
+static struct rngstream randstream;
 
 /****************************************************************************/
 /* jimsrand(): return a double in range [0,1].  The routine below is used to */
@@ -94,7 +296,10 @@ double jimsrand(void)
 {
   double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
   double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
+  if (FASTRAND)
+    x = RngNext(&randstream);
+  else
+    x = rand()/mmm;            /* x should be uniform in [0,1] */
   if (TRACE > 3)
     printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
   return(x);
@@ -165,6 +370,225 @@ void generate_next_arrival(void)
   insertevent(evptr);
 } 
 
+/* exponentially distributed random time with the given mean */
+double exponential(double mean)
+{
+#if CROSSTRAFFIC
+  double x;
+
+  do
+    x = jimsrand();
+  while (x == 0.0);
+  return -mean * log(x);
+#else
+  return mean;    /* not drawn without cross traffic, which keeps the default build free of libm */
+#endif
+}
+
+/* schedule the next cross-traffic packet.  Cross traffic stops once nothing else is
+   left to simulate, or the simulation would never end. */
+void generate_cross_traffic(void)
+{
+  double gap;
+  struct event *evptr, *q;
+
+  for (q = evlist; q != NULL; q = q->next)
+    if (q->evtype != CROSS_TRAFFIC && !(q->evtype == FROM_LAYER3 && q->cross))
+      break;
+  if (q == NULL)
+    return;
+
+  if (CROSSTRAFFIC == 2)
+    gap = exponential(CROSSINTERVAL);
+  else
+    gap = CROSSINTERVAL;
+  if (CROSSTRAFFIC == 3 && time + gap > cross_onend) {
+    /* the burst is over: stay quiet, then start the next one */
+    gap = cross_onend - time + exponential(CROSSOFF);
+    cross_onend = time + gap + exponential(CROSSON);
+  }
+
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime = time + gap;
+  evptr->evtype = CROSS_TRAFFIC;
+  evptr->eventity = CROSSDIRECTION;
+  insertevent(evptr);
+}
+
+/* load DELAYCDFFILE for the empirical delay model */
+void load_delay_cdf(void)
+{
+  FILE *fp;
+
+  ncdfpoints = 0;
+  if (DELAYMODEL_AB != 5 && DELAYMODEL_BA != 5)
+    return;
+  fp = fopen(DELAYCDFFILE, "r");
+  if (fp == NULL) {
+    printf("unable to open delay distribution file %s\n", DELAYCDFFILE);
+    exit(EXIT_FAILURE);
+  }
+  while (ncdfpoints < MAXCDFPOINTS
+         && fscanf(fp, "%f %f", &cdf_delay[ncdfpoints], &cdf_prob[ncdfpoints]) == 2)
+    ncdfpoints++;
+  fclose(fp);
+  if (ncdfpoints == 0) {
+    printf("no points in delay distribution file %s\n", DELAYCDFFILE);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* draw a delay from one of the models, with mean DELAYMEAN */
+double delaysample(int model)
+{
+  double u;
+#if DELAYLIBM
+  double v, sigma2, mu, xm;
+#endif
+  int i;
+
+  switch (model) {
+  case 1:
+    return DELAYMEAN;
+#if DELAYLIBM
+  /* the models that need libm, left out of the default build */
+  case 2:
+  case 3:
+    /* standard normal by Box-Muller */
+    do
+      u = jimsrand();
+    while (u == 0.0);
+    v = jimsrand();
+    u = sqrt(-2.0 * log(u)) * cos(2.0 * 3.14159265358979 * v);
+    if (model == 2)
+      return DELAYMEAN + DELAYSTDDEV * u;
+    sigma2 = log(1.0 + (DELAYSTDDEV * DELAYSTDDEV) / (DELAYMEAN * DELAYMEAN));
+    mu = log(DELAYMEAN) - sigma2 / 2;
+    return exp(mu + sqrt(sigma2) * u);
+  case 4:
+    xm = DELAYMEAN * (PARETOSHAPE - 1) / PARETOSHAPE;
+    do
+      u = jimsrand();
+    while (u == 0.0);
+    return xm / pow(u, 1.0 / PARETOSHAPE);
+#endif
+  default:
+    /* invert the empirical CDF, interpolating between its points */
+    u = jimsrand();
+    for (i = 0; i < ncdfpoints-1 && cdf_prob[i] < u; i++)
+      ;
+    if (i == 0 || cdf_prob[i] == cdf_prob[i-1])
+      return cdf_delay[i];
+    return cdf_delay[i-1] + (cdf_delay[i] - cdf_delay[i-1])
+           * (u - cdf_prob[i-1]) / (cdf_prob[i] - cdf_prob[i-1]);
+  }
+}
+
+/* arrival time of a packet put on 'link' of 'path' toward 'to' behind a packet arriving at lastime */
+double arrivaltime(float lastime, int to, int path, int link)
+{
+  int model = (to == B) ? DELAYMODEL_AB : DELAYMODEL_BA;
+  double prop = (to == B) ? PROPDELAY_AB : PROPDELAY_BA;
+  double bandwidth = (to == B) ? BANDWIDTH_AB : BANDWIDTH_BA;
+  double delay;
+
+  if (model == 0 && prop == 0.0 && bandwidth == 1.0)
+    return lastime + paths[path].mindelay*links[link].delayscale
+           + paths[path].spread*links[link].delayscale*jimsrand();
+
+  if (model == 0)
+    delay = paths[path].mindelay*links[link].delayscale
+            + paths[path].spread*links[link].delayscale*jimsrand();
+  else
+    delay = delaysample(model) * links[link].delayscale
+            * (paths[path].mindelay + paths[path].spread/2) / (paths[0].mindelay + paths[0].spread/2);
+  delay = delay / bandwidth;
+  if (delay < DELAYMIN)
+    delay = DELAYMIN;
+  if (lastime < time + prop)
+    lastime = time + prop;      /* the link is idle by the time the packet gets across */
+  return lastime + delay;
+}
+
+/* load SCENARIOFILE and schedule its changes */
+void load_scenario(void)
+{
+  static const char *actions[] = { "down", "up", "loss", "corrupt", "lambda", "rate" };
+  char line[128], action[16];
+  struct event *evptr;
+  FILE *fp;
+  float t, value;
+  int i, n;
+
+  nscenario = 0;
+  scenario_done = 0;
+  link_down = 0;
+  packets_outage = 0;
+  if (SCENARIOFILE[0] == '\0')
+    return;
+  fp = fopen(SCENARIOFILE, "r");
+  if (fp == NULL) {
+    printf("unable to open scenario file %s\n", SCENARIOFILE);
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    value = 0.0;
+    n = sscanf(line, "%f %15s %f", &t, action, &value);
+    if (n <= 0 || line[0] == '#')
+      continue;
+    for (i = 0; i < 6 && (n < 2 || strcmp(action, actions[i]) != 0); i++)
+      ;
+    if (i == 6 || (i >= SC_LOSS && n < 3)) {
+      printf("bad line in scenario file %s: %s", SCENARIOFILE, line);
+      exit(EXIT_FAILURE);
+    }
+    if (nscenario == MAXSCENARIO) {
+      printf("scenario file %s has more than %d changes\n", SCENARIOFILE, MAXSCENARIO);
+      exit(EXIT_FAILURE);
+    }
+    scenario[nscenario].time = t;
+    scenario[nscenario].action = i;
+    scenario[nscenario].value = value;
+    scenario[nscenario].firstdelivery = 0.0;
+    scenario[nscenario].delivered = 0;
+
+    evptr = malloc(sizeof(struct event));
+    if (evptr == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    evptr->evtime = t;
+    evptr->evtype = SCENARIO_EVENT;
+    evptr->eventity = nscenario;
+    insertevent(evptr);
+    nscenario++;
+  }
+  fclose(fp);
+}
+
+/* apply scenario change i */
+void apply_scenario(int i)
+{
+  struct change *c = &scenario[i];
+
+  if (TRACE>0)
+    printf("          SCENARIO: change %d at time %f\n", i, time);
+  switch (c->action) {
+  case SC_DOWN:    link_down = 1; break;
+  case SC_UP:      link_down = 0; break;
+  case SC_LOSS:    lossprob = lossprob_ba = c->value; break;
+  case SC_CORRUPT: corruptprob = corruptprob_ba = c->value; break;
+  case SC_LAMBDA:  lambda = c->value; break;
+  case SC_RATE:    lambda = lambda / c->value; break;
+  }
+  c->delivered = messages_delivered;
+  scenario_done = i + 1;
+}
+
 void printevlist(void)
 {
   struct event *q;
@@ -178,7 +602,7 @@ void printevlist(void)
 void init(void)                         /* initialize the simulator */
 {
   float sum, avg;
-  int i;
+  int i, j;
 
   printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
   printf("Enter the number of messages to simulate: ");
@@ -187,7 +611,14 @@ void init(void)                         /* initialize the simulator */
   scanf("%f",&lossprob);
   printf("Enter packet corruption probability [0.0 for no corruption]:");
   scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
+  if (ASYMMETRIC) {
+    printf("Enter packet loss probability from B to A [enter 0.0 for no loss]:");
+    scanf("%f",&lossprob_ba);
+    printf("Enter packet corruption probability from B to A [0.0 for no corruption]:");
+    scanf("%f",&corruptprob_ba);
+    corruptdirection = 2;     /* each direction has its own probabilities */
+  }
+  else if (lossprob != 0.0 || corruptprob != 0.0) {
     printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
     scanf("%d",&corruptdirection);
   }
@@ -198,6 +629,8 @@ void init(void)                         /* initialize the simulator */
 
 
   srand(9999);              /* init random number generator */
+  if (FASTRAND)
+    RngSeed(&randstream, 9999);
   sum = 0.0;                /* test random number generator for students */
   for (i=0; i<1000; i++)
     sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
@@ -211,22 +644,80 @@ void init(void)                         /* initialize the simulator */
 
   /* initialise statistics */
   window_full = 0;
+  for (i=0; i<ZCPOOL; i++)
+    zc_free[i] = ZCPOOL-1-i;
+  zc_nfree = ZCPOOL;
+  zc_maxheld = 0;
   total_ACKs_received = 0;
   packets_resent = 0;
   new_ACKs = 0;
   packets_received = 0;
+  tlp_probes = 0;
+  messages_abandoned = 0;
+  messages_skipped = 0;
+  window_reductions = 0;
+  packets_repaired = 0;
+  repairs_new = 0;
+  packets_cached = 0;
+  naks_sent = 0;
+  naks_aggregated = 0;
+  bulk_messages = 0;
+  bulk_packets = 0;
+  bulk_bytes = 0;
+  bulk_cpu = 0.0;
+  rtt_samples = 0;
+  rtt_total = 0.0;
+  rtt_min = 0.0;
+  rtt_max = 0.0;
+  for (i=0; i<RTTBINS; i++)
+    rtt_histogram[i] = 0;
   packets_lost = 0;  
   packets_corrupt = 0;
   packets_sent = 0;
   packets_timeout = 0;
   messages_delivered = 0;
+  packets_marked = 0;
+  lastdelivery = 0.0;
+  for (i=0; i<NRECEIVERS; i++) {
+    receiver_delivered[i] = 0;
+    receiver_lastdelivery[i] = 0.0;
+  }
+  for (i=0; i<NSTREAMS; i++) {
+    latency_samples[i] = 0;
+    latency_total[i] = 0.0;
+    latency_max[i] = 0.0;
+    for (j=0; j<LATENCYBINS; j++)
+      latency_histogram[i][j] = 0;
+  }
+  for (i=0; i<NPATHS; i++) {
+    path_sent[i] = 0;
+    path_lost[i] = 0;
+  }
+  for (i=0; i<NHOPS; i++)
+    link_lost[i] = 0;
+  link_resends = 0;
+  cross_sent = 0;
+  reorder_samples = 0;
+  reorder_total = 0.0;
+  reorder_max = 0.0;
 
   ntolayer3 = 0;
+  nevents = 0;
   nlost = 0;
   ncorrupt = 0;
+  for (i=0; i<2; i++) {
+    dir_lost[i] = 0;
+    dir_corrupt[i] = 0;
+  }
 
   time=0.0;                    /* initialize time to 0.0 */
   generate_next_arrival();     /* initialize event list */
+  load_delay_cdf();
+  load_scenario();
+  if (CROSSTRAFFIC) {
+    cross_onend = exponential(CROSSON);
+    generate_cross_traffic();
+  }
 }
 
 /********************** Student-callable ROUTINES ***********************/
@@ -294,23 +785,118 @@ void starttimer(int AorB, double increment)
 } 
 
 
+/* called by students routine to read the current simulation time */
+float currenttime(void)
+{
+  return time;
+}
+
+/* called by students routine to record an RTT sample taken from an echoed timestamp */
+void record_rtt(float sample)
+{
+  int bin;
+
+  if (sample < 0.0)
+    return;
+  if (rtt_samples == 0 || sample < rtt_min)
+    rtt_min = sample;
+  if (rtt_samples == 0 || sample > rtt_max)
+    rtt_max = sample;
+  rtt_samples++;
+  rtt_total += sample;
+  bin = (int)(sample / RTTBINWIDTH);
+  if (bin >= RTTBINS)
+    bin = RTTBINS - 1;
+  rtt_histogram[bin]++;
+}
+
+/* called by students routine when a message is delivered, with the time since it reached A_output() */
+void record_latency(int stream, float latency)
+{
+  int bin;
+
+  if (stream < 0 || stream >= NSTREAMS)
+    stream = 0;
+  latency_samples[stream]++;
+  latency_total[stream] += latency;
+  if (latency > latency_max[stream])
+    latency_max[stream] = latency;
+  bin = (int)(latency / LATENCYBINWIDTH);
+  if (bin >= LATENCYBINS)
+    bin = LATENCYBINS - 1;
+  latency_histogram[stream][bin]++;
+}
+
+/* called by students routine when a packet leaves the reorder buffer, with the time it waited there */
+void record_reorder(float wait)
+{
+  reorder_samples++;
+  reorder_total += wait;
+  if (wait > reorder_max)
+    reorder_max = wait;
+}
+
 /************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
+/* latest arrival time of the packets queued on hop 'hop' of 'path' toward 'to',
+   or now if the link is idle.  Each multicast receiver has a link of its own.  Sets *queued to the number of those packets. */
+static float lastarrival(int to, int path, int receiver, int hop, int *queued)
+{
+  struct event *q;
+  float lastime = time;
+
+  *queued = 0;
+  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
+  for (q=evlist; q!=NULL ; q = q->next) 
+    if ( (q->evtype==FROM_LAYER3  && q->eventity==to && q->pktptr->path==path
+          && q->pktptr->receiver==receiver && q->hop==hop) ) {
+      lastime = q->evtime;
+      (*queued)++;
+    }
+  return lastime;
+}
+
+/* put a packet on one link of its path toward entity 'to'.  hop counts the links
+   already crossed; relays between the links store and forward. */
+/* put a packet on link hop toward entity to.  The payload is passed apart from the
+   header so that a zero-copy sender's message goes straight into the channel's copy */
+static void transmit(int to, const struct pkt *packet, const char *payload,
+                     int path, int receiver, int hop)
 {
   struct pkt *mypktptr;
-  struct event *evptr,*q;
+  struct event *evptr;
   float lastime, x;
+  float loss, corrupt;
   int i;
+  int queued;
+  int link = (to == B) ? hop : NHOPS-1-hop;   /* both directions share each link */
+  int impaired = !(to == A && corruptdirection == A) && !(to == B && corruptdirection == B);
+  int retries = 0;
 
-  ntolayer3++;
+  if (link_down) {
+    nlost++;
+    dir_lost[to]++;
+    packets_outage++;
+    if (TRACE>0)
+      printf("          TOLAYER3: link is down, packet being lost\n");
+    return;
+  }
+
+  loss = (ASYMMETRIC && to == A) ? lossprob_ba : lossprob;
+  loss = loss * paths[path].lossscale * links[link].lossscale;
+  corrupt = (ASYMMETRIC && to == A) ? corruptprob_ba : corruptprob;
+  corrupt = corrupt * paths[path].corruptscale * links[link].corruptscale;
 
   /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+  while (jimsrand() < loss && impaired) {
     nlost++;
+    dir_lost[to]++;
+    path_lost[path]++;
+    link_lost[link]++;
     if (TRACE>0)    
       printf("          TOLAYER3: packet being lost\n");
-    return;
+    if (!HOPARQ || loss >= 1.0)
+      return;
+    retries++;        /* the link resends it after HOPRTO */
   }  
 
   /* make a copy of the packet student just gave me since he/she may decide */
@@ -320,11 +906,23 @@ void tolayer3(int AorB, struct pkt packet)
     printf("memory allocation for event failed.");
     exit(EXIT_FAILURE);
   }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
+  mypktptr->seqnum = packet->seqnum;
+  mypktptr->acknum = packet->acknum;
+  mypktptr->checksum = packet->checksum;
+  mypktptr->timestamp = packet->timestamp;
+  mypktptr->flags = packet->flags;
+  mypktptr->msgtime = packet->msgtime;
+  mypktptr->stream = packet->stream;
+  mypktptr->streamseq = packet->streamseq;
+  mypktptr->path = path;
+  mypktptr->hdrchecksum = packet->hdrchecksum;
+  mypktptr->parity = packet->parity;
+  mypktptr->receiver = receiver;
+  mypktptr->nonce = packet->nonce;
   for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
+    mypktptr->payload[i] = payload[i];
+  for (i=0; i<16; i++)
+    mypktptr->tag[i] = packet->tag[i];
   if (TRACE>2)  {
     printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
            mypktptr->acknum,  mypktptr->checksum);
@@ -340,24 +938,45 @@ void tolayer3(int AorB, struct pkt packet)
     exit(EXIT_FAILURE);
   }
   evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
-  evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
+  evptr->eventity = to;           /* event occurs at other entity, or the relay before it */
+  evptr->hop = hop;
+  evptr->cross = 0;
   evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
   /* finally, compute the arrival time of packet at the other end.
-     medium can not reorder, so make sure packet arrives between 1 and 10
-     time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
+     a link can not reorder, so make sure packet arrives between 1 and 10
+     time units (for path 0) after the latest arrival time of packets
+     currently on the same link on their way to the destination */
+  lastime = lastarrival(to, path, receiver, hop, &queued);
+  evptr->evtime =  arrivaltime(lastime, to, path, link);
+
+  /* signal congestion to ECN-capable senders by marking rather than dropping */
+  if (ECNTHRESHOLD > 0 && queued >= ECNTHRESHOLD && (mypktptr->flags & PKT_ECT)) {
+    packets_marked++;
+    mypktptr->flags |= PKT_CE;
+    if (TRACE>0)
+      printf("          TOLAYER3: packet being ECN marked\n");
+  }
  
 
 
   /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+  while ((jimsrand() < corrupt)  && impaired) {
     ncorrupt++;
+    dir_corrupt[to]++;
+    if (HOPARQ && corrupt < 1.0) {
+      /* the link's own check catches it and resends, and the resend may be lost too */
+      if (TRACE>0)
+        printf("          TOLAYER3: packet corrupted on link %d, resending\n", link);
+      retries++;
+      while (jimsrand() < loss && loss < 1.0) {
+        nlost++;
+        dir_lost[to]++;
+        path_lost[path]++;
+        link_lost[link]++;
+        retries++;
+      }
+      continue;
+    }
     if ( (x = jimsrand()) < .75)
       mypktptr->payload[0]='Z';   /* corrupt payload */
     else if (x < .875)
@@ -366,13 +985,92 @@ void tolayer3(int AorB, struct pkt packet)
       mypktptr->acknum = 999999;
     if (TRACE>0)    
       printf("          TOLAYER3: packet being corrupted\n");
+    break;
   }  
 
+  /* hop-by-hop ARQ holds the link while it resends, so later packets queue behind */
+  evptr->evtime += retries * HOPRTO;
+  link_resends += retries;
+
   if (TRACE>2)  
     printf("          TOLAYER3: scheduling arrival on other side\n");
   insertevent(evptr);
 } 
 
+static void send_packet(int AorB, const struct pkt *packet, const char *payload)
+{
+  int path = (packet->path >= 0 && packet->path < NPATHS) ? packet->path : 0;
+  int receiver = (packet->receiver >= 0 && packet->receiver < NRECEIVERS) ? packet->receiver : 0;
+
+  ntolayer3++;
+  path_sent[path]++;
+  if (AorB == A && NRECEIVERS > 1) {
+    /* broadcast: every receiver gets its own copy */
+    for (receiver = 0; receiver < NRECEIVERS; receiver++)
+      transmit(B, packet, payload, path, receiver, 0);
+    return;
+  }
+  transmit((AorB+1) % 2, packet, payload, path, receiver, 0);
+}
+
+void tolayer3(int AorB, struct pkt packet)
+/* A or B is sending to network  */
+{
+  send_packet(AorB, &packet, packet.payload);
+}
+
+void tolayer3_zc(int AorB, const struct pkt *header, const char payload[20])
+/* zero-copy send: the header's payload is ignored, the 20 bytes at payload are sent */
+{
+  send_packet(AorB, header, payload);
+}
+
+/* put one cross-traffic packet on the first link toward CROSSDIRECTION */
+static void send_cross_traffic(void)
+{
+  struct pkt *mypktptr;
+  struct event *evptr;
+  float lastime;
+  int i, queued;
+  int link = (CROSSDIRECTION == B) ? 0 : NHOPS-1;
+
+  mypktptr = malloc(sizeof(struct pkt));
+  evptr = malloc(sizeof(struct event));
+  if (mypktptr == 0 || evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  mypktptr->seqnum = -1;
+  mypktptr->acknum = -1;
+  mypktptr->checksum = 0;
+  mypktptr->flags = 0;
+  mypktptr->path = 0;
+  mypktptr->receiver = 0;
+  mypktptr->nonce = 0;
+  for (i=0; i<20; i++)
+    mypktptr->payload[i] = 'x';
+  for (i=0; i<16; i++)
+    mypktptr->tag[i] = 0;
+
+  evptr->evtype = FROM_LAYER3;
+  evptr->eventity = CROSSDIRECTION;
+  evptr->hop = 0;
+  evptr->cross = 1;
+  evptr->pktptr = mypktptr;
+  lastime = lastarrival(CROSSDIRECTION, 0, 0, 0, &queued);
+  evptr->evtime = arrivaltime(lastime, CROSSDIRECTION, 0, link);
+  cross_sent++;
+  if (TRACE>2)
+    printf("          CROSS TRAFFIC: packet queued behind %d others\n", queued);
+  insertevent(evptr);
+}
+
+/* A is done with a zero-copy message: its buffer is free again */
+static void zc_release(struct msg *message)
+{
+  zc_free[zc_nfree++] = message - zc_pool;
+}
+
 void tolayer5(int AorB, char datasent[20])
 {
   int i;  
@@ -387,6 +1085,14 @@ void tolayer5(int AorB, char datasent[20])
     printf("\n");
   }
   messages_delivered++;
+  lastdelivery = time;
+  if (AorB == B) {
+    receiver_delivered[receiving]++;
+    receiver_lastdelivery[receiving] = time;
+  }
+  for (i=0; i<scenario_done; i++)
+    if (scenario[i].firstdelivery == 0.0)
+      scenario[i].firstdelivery = time;
 }
 
 int main(void)
@@ -406,6 +1112,7 @@ int main(void)
     if (eventptr==NULL)
       goto terminate;
     evlist = evlist->next;        /* remove this event from event list */
+    nevents++;
     if (evlist!=NULL)
       evlist->prev=NULL;
     if (TRACE>=2) {
@@ -427,6 +1134,8 @@ int main(void)
         j = nsim % 26; 
         for (i=0; i<20; i++)  
           msg2give.data[i] = 97 + j;
+        msg2give.lifetime = MSGLIFETIME;
+        msg2give.stream = nsim % NSTREAMS;
         if (TRACE>2) {
           printf("          MAINLOOP: data given to student: ");
           for (i=0; i<20; i++) 
@@ -434,7 +1143,14 @@ int main(void)
           printf("\n");
         }
         nsim++;
-        if (eventptr->eventity == A) 
+        if (eventptr->eventity == A && ZEROCOPY && zc_nfree > 0) {
+          struct msg *message = &zc_pool[zc_free[--zc_nfree]];
+          *message = msg2give;
+          if (ZCPOOL - zc_nfree > zc_maxheld)
+            zc_maxheld = ZCPOOL - zc_nfree;
+          A_output_zc(message, zc_release);
+        }
+        else if (eventptr->eventity == A) 
           A_output(msg2give);  
         else
           B_output(msg2give);  
@@ -442,16 +1158,49 @@ int main(void)
       else if (TRACE > 2)
           printf("          FROM_LAYER5: no more messages to send: \n");
     }
+    else if (eventptr->evtype ==  SCENARIO_EVENT) {
+      apply_scenario(eventptr->eventity);
+    }
+    else if (eventptr->evtype ==  CROSS_TRAFFIC) {
+      send_cross_traffic();
+      generate_cross_traffic();
+    }
+    else if (eventptr->evtype ==  FROM_LAYER3 && eventptr->cross) {
+      free(eventptr->pktptr);       /* cross traffic leaves the channel */
+    }
+    else if (eventptr->evtype ==  FROM_LAYER3 && eventptr->hop < NHOPS-1) {
+      /* a relay stores the packet and forwards it on the next link */
+      if (TRACE>2)
+        printf("          RELAY: forwarding packet toward %c on link %d\n",
+               eventptr->eventity == A ? 'A' : 'B', eventptr->hop+1);
+      transmit(eventptr->eventity, eventptr->pktptr, eventptr->pktptr->payload,
+               eventptr->pktptr->path, eventptr->pktptr->receiver, eventptr->hop+1);
+      free(eventptr->pktptr);
+    }
     else if (eventptr->evtype ==  FROM_LAYER3) {
       pkt2give.seqnum = eventptr->pktptr->seqnum;
       pkt2give.acknum = eventptr->pktptr->acknum;
       pkt2give.checksum = eventptr->pktptr->checksum;
+      pkt2give.timestamp = eventptr->pktptr->timestamp;
+      pkt2give.flags = eventptr->pktptr->flags;
+      pkt2give.msgtime = eventptr->pktptr->msgtime;
+      pkt2give.stream = eventptr->pktptr->stream;
+      pkt2give.streamseq = eventptr->pktptr->streamseq;
+      pkt2give.path = eventptr->pktptr->path;
+      pkt2give.hdrchecksum = eventptr->pktptr->hdrchecksum;
+      pkt2give.parity = eventptr->pktptr->parity;
+      pkt2give.receiver = eventptr->pktptr->receiver;
+      pkt2give.nonce = eventptr->pktptr->nonce;
       for (i=0; i<20; i++)  
         pkt2give.payload[i] = eventptr->pktptr->payload[i];
+      for (i=0; i<16; i++)
+        pkt2give.tag[i] = eventptr->pktptr->tag[i];
 	    if (eventptr->eventity ==A)      /* deliver packet by calling */
         A_input(pkt2give);            /* appropriate entity */
-      else
+      else {
+        receiving = pkt2give.receiver;
         B_input(pkt2give);
+      }
 	    free(eventptr->pktptr);          /* free the memory for packet */
     }
     else if (eventptr->evtype ==  TIMER_INTERRUPT) {
@@ -474,5 +1223,103 @@ int main(void)
   printf("number of packet resends by A:  %d \n", packets_resent);
   printf("number of correct packets received at B:  %d \n", packets_received);
   printf("number of messages delivered to application:  %d \n", messages_delivered);
+  printf("time the last message was delivered to application:  %f \n", lastdelivery);
+  if (lastdelivery > 0.0)
+    printf("goodput (messages delivered per time unit):  %f \n", messages_delivered/lastdelivery);
+  printf("number of events simulated:  %ld \n", nevents);
+  if (ZEROCOPY)
+    printf("zero-copy message buffers held by A:  at most %d, %d at the end \n",
+           zc_maxheld, ZCPOOL - zc_nfree);
+  if (tlp_probes > 0)
+    printf("number of tail loss probes sent by A:  %d \n", tlp_probes);
+  if (packets_marked > 0)
+    printf("number of packets ECN marked by the channel:  %d \n", packets_marked);
+  if (window_reductions > 0)
+    printf("number of congestion window reductions by A:  %d \n", window_reductions);
+  if (packets_repaired > 0)
+    printf("number of packets B rebuilt from corrupted copies:  %d, of which not yet received (resends avoided):  %d \n",
+           packets_repaired, repairs_new);
+  if (packets_cached > 0)
+    printf("number of out-of-order packets B held for later delivery:  %d \n", packets_cached);
+  if (bulk_packets > 0)
+    printf("number of messages sent compressed:  %d in %d packets, %d of %d payload bytes used, %d wire bytes saved, %.0f ns CPU per message \n",
+           bulk_messages, bulk_packets, bulk_bytes, 20*bulk_packets, 20*(bulk_messages - bulk_packets),
+           bulk_cpu*1e9/bulk_messages);
+  for (i=0; i<NSTREAMS; i++) {
+    if (latency_samples[i] == 0)
+      continue;
+    printf("latency of messages delivered on stream %d:  avg %f, max %f \n",
+           i, latency_total[i]/latency_samples[i], latency_max[i]);
+    for (j=0; j<LATENCYBINS; j++) {
+      if (latency_histogram[i][j] == 0)
+        continue;
+      if (j == LATENCYBINS-1)
+        printf("  [%6.1f,    inf): %d\n", j*LATENCYBINWIDTH, latency_histogram[i][j]);
+      else
+        printf("  [%6.1f, %6.1f): %d\n", j*LATENCYBINWIDTH, (j+1)*LATENCYBINWIDTH, latency_histogram[i][j]);
+    }
+  }
+  if (NRECEIVERS > 1) {
+    float slowest = 0.0;
+    for (i=0; i<NRECEIVERS; i++) {
+      float goodput = receiver_lastdelivery[i] > 0.0 ? receiver_delivered[i]/receiver_lastdelivery[i] : 0.0;
+      printf("receiver %d:  %d messages delivered, goodput %f \n", i, receiver_delivered[i], goodput);
+      if (i == 0 || goodput < slowest)
+        slowest = goodput;
+    }
+    printf("goodput of the slowest of %d receivers:  %f \n", NRECEIVERS, slowest);
+    printf("number of NAKs sent by the receivers:  %d, answered by an earlier resend:  %d \n",
+           naks_sent, naks_aggregated);
+  }
+  if (NPATHS > 1)
+    for (i=0; i<NPATHS; i++)
+      printf("path %d:  %d packets sent, %d lost \n", i, path_sent[i], path_lost[i]);
+  if (NHOPS > 1)
+    for (i=0; i<NHOPS; i++)
+      printf("link %d:  %d packets lost \n", i, link_lost[i]);
+  for (i=0; i<nscenario; i++) {
+    /* goodput from this change up to the next one, or the last delivery */
+    float until = (i+1 < nscenario) ? scenario[i+1].time : lastdelivery;
+    int count = ((i+1 < nscenario) ? scenario[i+1].delivered : messages_delivered)
+                - scenario[i].delivered;
+
+    printf("scenario change %d at time %f: ", i, scenario[i].time);
+    if (scenario[i].firstdelivery > 0.0)
+      printf("first delivery after %f, ", scenario[i].firstdelivery - scenario[i].time);
+    else
+      printf("no delivery after it, ");
+    printf("goodput until the next change %f \n",
+           until > scenario[i].time ? count / (until - scenario[i].time) : 0.0);
+  }
+  if (ASYMMETRIC) {
+    printf("packets lost A->B:  %d, B->A:  %d \n", dir_lost[B], dir_lost[A]);
+    printf("packets corrupted A->B:  %d, B->A:  %d \n", dir_corrupt[B], dir_corrupt[A]);
+  }
+  if (packets_outage > 0)
+    printf("number of packets lost while the link was down:  %d \n", packets_outage);
+  if (cross_sent > 0)
+    printf("number of cross-traffic packets sent on the channel:  %d \n", cross_sent);
+  if (link_resends > 0)
+    printf("number of resends by hop-by-hop ARQ on the links:  %d \n", link_resends);
+  if (reorder_samples > 0)
+    printf("number of packets held in the reorder buffer at B:  %d (avg wait %f, max %f)\n",
+           reorder_samples, reorder_total/reorder_samples, reorder_max);
+  if (messages_abandoned > 0 || messages_skipped > 0) {
+    printf("number of messages abandoned by A after their lifetime expired:  %d \n", messages_abandoned);
+    printf("number of sequence numbers skipped by B on a forward-skip:  %d \n", messages_skipped);
+  }
+  if (rtt_samples > 0) {
+    printf("number of RTT samples from echoed timestamps:  %d (min %f, avg %f, max %f)\n",
+           rtt_samples, rtt_min, rtt_total/rtt_samples, rtt_max);
+    printf("RTT histogram:\n");
+    for (i=0; i<RTTBINS; i++) {
+      if (rtt_histogram[i] == 0)
+        continue;
+      if (i == RTTBINS-1)
+        printf("  [%6.1f,    inf): %d\n", i*RTTBINWIDTH, rtt_histogram[i]);
+      else
+        printf("  [%6.1f, %6.1f): %d\n", i*RTTBINWIDTH, (i+1)*RTTBINWIDTH, rtt_histogram[i]);
+    }
+  }
   return EXIT_SUCCESS;
 }
\ No newline at end of file
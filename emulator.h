@@ -6,6 +6,46 @@ extern int packets_resent;       /* count of the number of packets resent  */
 extern int new_ACKs;      /* count of the number of acks correctly received */
 extern int packets_received;  /* count of the packets received by receiver */
 extern int window_full; /* count of the number of messages dropped due to full window */
+extern int tlp_probes;  /* count of the tail loss probes sent */
+extern int messages_abandoned; /* count of messages the sender gave up on after their lifetime expired */
+extern int messages_skipped;   /* count of sequence numbers the receiver skipped on a forward-skip */
+extern int window_reductions;  /* count of the times the sender reduced its congestion window */
+extern int packets_repaired;   /* count of valid packets the receiver rebuilt from corrupted copies */
+extern int repairs_new;        /* of those, the packets the receiver had not received intact yet */
+extern int packets_cached;     /* count of out-of-order packets the GBN receiver held for later delivery */
+extern int naks_sent;          /* count of NAKs sent by the multicast receivers */
+extern int naks_aggregated;    /* count of NAKs the sender answered with an earlier resend */
+extern int bulk_messages;      /* count of messages sent coalesced into compressed packets */
+extern int bulk_packets;       /* count of compressed packets they were sent in */
+extern int bulk_bytes;         /* payload bytes the compressed data took */
+extern double bulk_cpu;        /* CPU seconds spent compressing and decompressing */
+extern void record_latency(int, float); /* add the latency of one message delivered to layer 5 on a stream */
+extern void record_reorder(float);      /* add the time one packet waited in the receiver's reorder buffer */
+
+/* per-stream latency histograms */
+#define LATENCYBINS     20    /* number of bins in each latency histogram */
+#define LATENCYBINWIDTH 5.0   /* width of each histogram bin in time units */
+
+/* number of independent ordered streams multiplexed on one SR connection.
+   Message i is sent on stream i % NSTREAMS. */
+#define NSTREAMS 1
+
+/* number of paths between A and B, each with its own delay and impairments (see paths[]
+   in emulator.c).  The sender picks the path of each packet in pkt.path. */
+#define NPATHS 1
+
+/* number of receivers served by the sender over a broadcast channel (reliable multicast).
+   Each receiver gets its own copy of every packet A sends, lost and corrupted
+   independently; pkt.receiver tells B which receiver a packet is for and A which
+   receiver an ACK or NAK is from.  1 = the usual A to B connection.  At most 30. */
+#define NRECEIVERS 1
+
+/* RTT samples taken by the sender from timestamps echoed in ACKs */
+#define RTTBINS     20    /* number of bins in the RTT histogram */
+#define RTTBINWIDTH 2.0   /* width of each histogram bin in time units */
+extern int rtt_samples;              /* number of RTT samples recorded */
+extern int rtt_histogram[RTTBINS];   /* last bin also counts samples beyond the range */
+extern void record_rtt(float);       /* add one RTT sample to the statistics */
 
 #define   A    0
 #define   B    1
@@ -15,6 +55,8 @@ extern int window_full; /* count of the number of messages dropped due to full w
 /* to layer 5 via the students transport level protocol entities.         */
 struct msg {
   char data[20];
+  float lifetime;   /* time after which the sender may abandon the message, 0.0 = fully reliable */
+  int stream;       /* stream the message belongs to, 0 .. NSTREAMS-1 */
 };
 
 /* a packet is the data unit passed from layer 4 (students code) to layer */
@@ -25,11 +67,38 @@ struct pkt {
   int acknum;
   int checksum;
   char payload[20];
+  float timestamp;  /* time the packet was (re)sent, echoed back by the receiver in its ACK */
+  int flags;        /* PKT_ option bits below */
+  float msgtime;    /* time the message reached A_output(), used for latency statistics */
+  int stream;       /* stream the payload belongs to */
+  int streamseq;    /* position of the payload within its stream */
+  int path;         /* path the packet travels on, 0 .. NPATHS-1; not covered by the checksum */
+  int hdrchecksum;  /* checksum of the header fields alone, lets the receiver tell which part
+                       of a corrupted packet is intact */
+  int parity;       /* seqnum - acknum: with the header checksum it rebuilds whichever of
+                       the two was corrupted (an xor would let a wrong guess check out) */
+  int receiver;     /* multicast receiver, 0 .. NRECEIVERS-1; not covered by the checksum */
+  int nonce;        /* AEAD: the sender's packet counter, makes the GCM nonce unique */
+  unsigned char tag[16]; /* AEAD: GCM authentication tag over the header and payload */
 };
 
+/* packet option bits */
+#define PKT_FORWARD 0x1   /* forward-skip: packets from acknum up to seqnum were abandoned,
+                             ACKed with acknum = seqnum */
+#define PKT_ECT     0x2   /* sender understands ECN, the channel may mark instead of drop */
+#define PKT_CE      0x4   /* congestion experienced, set by the channel */
+#define PKT_ECE     0x8   /* ECN echo: the receiver saw a CE mark */
+#define PKT_NAK     0x10  /* multicast: the receiver is missing packet acknum */
+#define PKT_COMPRESSED 0x20 /* payload[0] bytes of compressed messages follow in payload[1..] */
+#define PKT_ECNMASK (PKT_ECT | PKT_CE)  /* network-level bits, not covered by the checksum */
+
 /* send to A or B (int), packet to send */
 extern void tolayer3(int, struct pkt);  
 
+/* send to A or B (int) the header (struct pkt *) with the 20 payload bytes (char *)
+   in place of its own, copied once straight into the channel */
+extern void tolayer3_zc(int, const struct pkt *, const char[20]);
+
 /* deliver to A or B (int), data to deliver */
 extern void tolayer5(int, char[20]); 
 
@@ -38,3 +107,6 @@ extern void starttimer(int, double);
 
 /* stop timer at A or B (int) */
 extern void stoptimer(int);               
+
+/* current simulation time */
+extern float currenttime(void);
@@ -0,0 +1,411 @@
+/**********************************************************************
+   Explicit-state explorer for the SR and GBN state machines
+
+   Instead of sampling random channel behaviour like the emulator, the
+   explorer enumerates every choice the channel can make for a small
+   configuration: each packet in flight may be delivered, lost or (a
+   bounded number of times) duplicated, packets may overtake each other,
+   and A's timer may go off whenever it is running.  Time stands still,
+   so timeouts are just one more choice.
+
+   The protocol is compiled into the explorer (#include), which lets it
+   save and restore the protocol's static variables as part of each
+   state.  States are explored breadth first and only a 64-bit hash of
+   each visited state is kept (hash compaction), so the first violation
+   found comes with a shortest trace, at the cost of a tiny chance of
+   mistaking a new state for a visited one.  Checked properties:
+     - B delivers the messages in order, each exactly once
+     - the transfer never gets stuck: with nothing in flight and the
+       timer off, everything sent has been delivered
+   With more than one worker, the explorer expands the first levels
+   itself and forks workers that each search part of the frontier.
+   The visited set is shared between them (mapped MAP_SHARED, hashes
+   inserted with compare-and-swap), so a state reachable from several
+   parts of the frontier is expanded by whichever worker gets there
+   first, and by no other.
+
+   Build with a small window (sequence space follows from it):
+     gcc -O2 -DWINDOWSIZE=2 explorer.c -o explore_sr
+     gcc -O2 -DWINDOWSIZE=2 -DEXPLORE_GBN explorer.c -o explore_gbn
+   Run:
+     ./explore_sr [messages] [channel capacity] [duplicates] [reorder 0/1] [workers]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#ifdef EXPLORE_GBN
+#include "gbn.c"
+#define PROTOCOL "gbn"
+#define PROTOCOL_STATE(X) X(buffer) X(windowfirst) X(windowlast) X(windowcount) \
+  X(A_nextseqnum) X(srtt) X(rttvar) X(rto) X(rto_deadline) X(probe_pending) X(deadline) \
+  X(forwardseq) X(forwardfrom) X(cwnd) X(recovery_end) X(recovering) X(recoverfrom) \
+  X(recoverto) X(expectedseqnum) X(B_nextseqnum) X(cache) X(cached) X(cachefirst)
+#else
+#include "sr.c"
+#define PROTOCOL "sr"
+#define PROTOCOL_STATE(X) X(buffer) X(acked) X(base) X(nextseqnum) X(timer_running) \
+  X(srtt) X(rttvar) X(rto) X(rto_deadline) X(probe_pending) X(probe_deadline) X(deadline) \
+  X(abandoned) X(forwardseq) X(skippedby) X(streamnext) X(cwnd) X(recovery_end) X(pathrtt) X(nextpath) X(ackedby) X(nak_holdoff) \
+  X(sendqueue) X(queuetime) X(queuefirst) X(queuecount) X(pace_deadline) X(delivered_count) \
+  X(delivered_time) X(sent_delivered) X(sent_delivered_time) X(bwsamples) X(btlbw) X(minrtt) \
+  X(minrtt_stamp) X(round_count) X(round_end) X(bbr_state) X(pacing_gain) X(cwnd_gain) \
+  X(full_bw) X(full_bw_rounds) X(cycle_index) X(cycle_stamp) \
+  X(recv_buffer) X(received) X(delivered) X(expectedseqnum) X(streamexpected) X(arrival) \
+  X(pool) X(poolseq) X(poolsize) X(poolnext) X(nak_time) X(receiver_state) X(receiver)
+#endif
+
+#define MAXCHANNEL 4          /* packets each direction can hold */
+#define MAXSTATES 4000000     /* give up after this many states */
+
+/* statistics the protocols update, normally defined by the emulator */
+int TRACE = 0;
+int total_ACKs_received;
+int packets_resent;
+int new_ACKs;
+int packets_received;
+int window_full;
+int tlp_probes;
+int messages_abandoned;
+int messages_skipped;
+int window_reductions;
+int packets_repaired;
+int repairs_new;
+int packets_cached;
+int naks_sent;
+int naks_aggregated;
+int bulk_messages;
+int bulk_packets;
+int bulk_bytes;
+double bulk_cpu;
+int rtt_samples;
+int rtt_histogram[RTTBINS];
+
+/* everything outside the protocol that makes up a state */
+struct world {
+  struct pkt channel[2][MAXCHANNEL];  /* packets on their way to A and to B */
+  int count[2];
+  int sent;           /* messages given to A */
+  int received;       /* messages delivered to layer 5 at B */
+  int duplicates;     /* duplicates the channel has made so far */
+  int timer;          /* A's timer is running */
+  int violation;      /* set by tolayer5 when B delivers out of order */
+};
+
+/* a visited state: how it was reached, and its contents until it is expanded */
+struct node {
+  int parent;
+  char step[56];
+  unsigned char *state;
+};
+
+#define SIZEOF(v) + sizeof(v)
+#define STATESIZE (sizeof(struct world) PROTOCOL_STATE(SIZEOF))
+
+static struct world world;
+static int messages = 4, capacity = 2, maxduplicates = 1, reorder = 1, workers = 1;
+static struct node *nodes;
+static int nnodes;
+static uint64_t *visited;     /* open addressing table of state hashes, 0 = empty, shared
+                                 with the workers */
+static uint64_t tablesize;
+static uint64_t *found;       /* states in visited, shared with the workers */
+
+/********************* stubs for the emulator routines ************/
+
+void tolayer3(int AorB, struct pkt packet)
+{
+  int to = (AorB + 1) % 2;
+
+  if (world.count[to] < capacity)   /* a full channel loses the packet */
+    world.channel[to][world.count[to]++] = packet;
+}
+
+void tolayer3_zc(int AorB, const struct pkt *header, const char payload[20])
+{
+  struct pkt packet = *header;
+
+  memcpy(packet.payload, payload, sizeof(packet.payload));
+  tolayer3(AorB, packet);
+}
+
+void tolayer5(int AorB, char datasent[20])
+{
+  (void)AorB;
+  if (world.received >= world.sent || datasent[0] != 'a' + world.received % 26)
+    world.violation = 1;
+  world.received++;
+}
+
+void starttimer(int AorB, double increment)
+{
+  (void)AorB;
+  (void)increment;
+  world.timer = 1;
+}
+
+void stoptimer(int AorB)
+{
+  (void)AorB;
+  world.timer = 0;
+}
+
+float currenttime(void)
+{
+  return 0.0;
+}
+
+void record_rtt(float sample) { (void)sample; }
+void record_latency(int stream, float latency) { (void)stream; (void)latency; }
+void record_reorder(float wait) { (void)wait; }
+
+/********************* states ************/
+
+#define SAVE(v) memcpy(p, &v, sizeof(v)); p += sizeof(v);
+#define RESTORE(v) memcpy(&v, p, sizeof(v)); p += sizeof(v);
+
+static void Save(unsigned char *p)
+{
+  memcpy(p, &world, sizeof(world));
+  p += sizeof(world);
+  PROTOCOL_STATE(SAVE)
+}
+
+static void Restore(const unsigned char *p)
+{
+  memcpy(&world, p, sizeof(world));
+  p += sizeof(world);
+  PROTOCOL_STATE(RESTORE)
+}
+
+/* FNV-1a, never 0 so 0 can mark an empty slot */
+static uint64_t Hash(const unsigned char *p)
+{
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < STATESIZE; i++)
+    h = (h ^ p[i]) * 1099511628211ULL;
+  return h ? h : 1;
+}
+
+/* record the current state as reached from parent by step, unless it was seen before */
+static void Visit(int parent, const char *step)
+{
+  unsigned char *state;
+  uint64_t h, slot;
+
+  if (nnodes == MAXSTATES) {
+    printf("%s: more than %d states, giving up\n", PROTOCOL, MAXSTATES);
+    exit(EXIT_FAILURE);
+  }
+  state = malloc(STATESIZE);
+  if (state == NULL) {
+    printf("%s: out of memory after %d states\n", PROTOCOL, nnodes);
+    exit(EXIT_FAILURE);
+  }
+  memset(state, 0, STATESIZE);
+  Save(state);
+  h = Hash(state);
+  for (slot = h & (tablesize - 1); ; slot = (slot + 1) & (tablesize - 1)) {
+    uint64_t seen = __sync_val_compare_and_swap(&visited[slot], 0, h);
+    if (seen == 0)
+      break;                    /* claimed by this process */
+    if (seen == h) {
+      free(state);
+      return;
+    }
+  }
+  __sync_fetch_and_add(found, 1);
+
+  nodes[nnodes].parent = parent;
+  strncpy(nodes[nnodes].step, step, sizeof(nodes[nnodes].step) - 1);
+  nodes[nnodes].state = state;
+  nnodes++;
+}
+
+static void PrintTrace(int n)
+{
+  if (n < 0)
+    return;
+  PrintTrace(nodes[n].parent);
+  if (nodes[n].parent >= 0)
+    printf("  %s\n", nodes[n].step);
+}
+
+/* check the state just restored, report and stop on a violation */
+static void Check(int n)
+{
+  const char *problem = NULL;
+
+  if (world.violation)
+    problem = "B delivered a message out of order or twice";
+  else if (world.count[A] == 0 && world.count[B] == 0 && !world.timer && world.received < world.sent
+           && world.sent == messages)
+    problem = "stuck: nothing in flight, timer off, messages undelivered";
+  if (problem == NULL)
+    return;
+  printf("%s: %s after %d states, trace:\n", PROTOCOL, problem, nnodes);
+  PrintTrace(n);
+  exit(EXIT_FAILURE);
+}
+
+/* try every choice from state n */
+static void Expand(int n)
+{
+  unsigned char *state = nodes[n].state;
+  struct msg message;
+  struct pkt packet;
+  char step[56];
+  int to, k, i, refused;
+
+  Restore(state);
+  Check(n);
+
+  if (world.sent < messages) {
+    for (i = 0; i < 20; i++)
+      message.data[i] = 'a' + world.sent % 26;
+    message.lifetime = 0.0;
+    message.stream = 0;
+    world.sent++;
+    refused = window_full;
+    A_output(message);
+    /* a message refused with a full window is offered again later */
+    if (window_full == refused) {
+      snprintf(step, sizeof(step), "A is given message %d", world.sent - 1);
+      Visit(n, step);
+    }
+    Restore(state);
+  }
+
+  if (world.timer) {
+    world.timer = 0;
+    A_timerinterrupt();
+    Visit(n, "A's timer goes off");
+    Restore(state);
+  }
+
+  for (to = 0; to < 2; to++)
+    for (k = 0; k < world.count[to]; k++) {
+      packet = world.channel[to][k];
+
+      /* lose it */
+      world.count[to]--;
+      memmove(&world.channel[to][k], &world.channel[to][k+1], (world.count[to] - k) * sizeof(packet));
+      snprintf(step, sizeof(step), "lose seq %d ack %d to %c", packet.seqnum, packet.acknum, to == A ? 'A' : 'B');
+      Visit(n, step);
+      Restore(state);
+
+      if (k > 0 && !reorder)
+        continue;
+
+      /* deliver it */
+      world.count[to]--;
+      memmove(&world.channel[to][k], &world.channel[to][k+1], (world.count[to] - k) * sizeof(packet));
+      if (to == A)
+        A_input(packet);
+      else
+        B_input(packet);
+      snprintf(step, sizeof(step), "deliver seq %d ack %d to %c", packet.seqnum, packet.acknum, to == A ? 'A' : 'B');
+      Visit(n, step);
+      Restore(state);
+
+      /* deliver a copy and keep it in flight */
+      if (world.duplicates < maxduplicates) {
+        world.duplicates++;
+        if (to == A)
+          A_input(packet);
+        else
+          B_input(packet);
+        snprintf(step, sizeof(step), "duplicate seq %d ack %d to %c", packet.seqnum, packet.acknum, to == A ? 'A' : 'B');
+        Visit(n, step);
+        Restore(state);
+      }
+    }
+
+  free(nodes[n].state);
+  nodes[n].state = NULL;
+}
+
+/* zeroed memory that forked workers share with the explorer */
+static void *Shared(size_t size)
+{
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/* worker w of nworkers: expand its share of the frontier first .. last-1, then
+   everything it reaches from there */
+static void Search(int first, int last, int w, int nworkers)
+{
+  int n;
+
+  for (n = first; n < nnodes; n++) {
+    if (n < last && (n - first) % nworkers != w) {
+      free(nodes[n].state);     /* another worker's */
+      nodes[n].state = NULL;
+      continue;
+    }
+    Expand(n);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int w, status, failed = 0;
+  int frontier, last;
+
+  if (argc > 1) messages = atoi(argv[1]);
+  if (argc > 2) capacity = atoi(argv[2]);
+  if (argc > 3) maxduplicates = atoi(argv[3]);
+  if (argc > 4) reorder = atoi(argv[4]);
+  if (argc > 5) workers = atoi(argv[5]);
+  if (capacity > MAXCHANNEL) capacity = MAXCHANNEL;
+  if (workers < 1) workers = 1;
+
+  nodes = malloc(MAXSTATES * sizeof(struct node));
+  for (tablesize = 1; tablesize < 2 * (uint64_t)MAXSTATES; tablesize *= 2)
+    ;
+  visited = Shared(tablesize * sizeof(uint64_t));
+  found = Shared(sizeof(uint64_t));
+  if (nodes == NULL || visited == NULL || found == NULL) {
+    printf("%s: out of memory\n", PROTOCOL);
+    return EXIT_FAILURE;
+  }
+
+  memset(&world, 0, sizeof(world));
+  A_init();
+  B_init();
+  Visit(-1, "start");
+
+  /* expand the first levels here, until there is work for every worker */
+  for (frontier = 0; frontier < nnodes && (workers == 1 || nnodes - frontier < 8 * workers); frontier++)
+    Expand(frontier);
+
+  if (workers > 1 && frontier < nnodes) {
+    last = nnodes;
+    for (w = 0; w < workers; w++)
+      if (fork() == 0) {
+        Search(frontier, last, w, workers);
+        printf("%s: worker %d found %d states\n", PROTOCOL, w, nnodes - last);
+        exit(EXIT_SUCCESS);
+      }
+    for (w = 0; w < workers; w++) {
+      wait(&status);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        failed = 1;
+    }
+    if (failed)
+      return EXIT_FAILURE;
+  }
+
+  printf("%s: window %d, sequence space %d, %d messages, channel capacity %d, %d duplicates%s: "
+         "%d states, no violation\n", PROTOCOL, WINDOWSIZE, SEQSPACE, messages, capacity,
+         maxduplicates, reorder ? ", reordering" : "", (int)*found);
+  return EXIT_SUCCESS;
+}
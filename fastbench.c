@@ -0,0 +1,109 @@
+/**********************************************************************
+   Benchmark of the window-specialised protocol builds (fastpath.c)
+
+   Builds sr.c (or gbn.c) once for each specialised window and once with
+   -DGENERIC_WINDOW, links them with bench.c and fastpath.c, then runs
+   the bench at each specialised window twice: with the specialised
+   handlers, and with FASTPATH=generic.  Reports the ns per call of
+   each bench pattern both ways.
+
+   Build and run from the directory holding the emulator sources:
+     gcc -O2 fastbench.c -o fastbench
+     ./fastbench [sr|gbn] [messages]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CFLAGS "-O2"
+#define PATTERNS 3        /* lines of bench output: in-order, lossy, reordered */
+
+static const int windows[] = { 8, 128, 1024 };   /* as SPECIALISED in fastpath.c */
+#define NWINDOWS ((int)(sizeof(windows) / sizeof(windows[0])))
+
+static void Build(const char *command)
+{
+  if (system(command) != 0) {
+    printf("unable to build: %s\n", command);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* run the bench with the given handlers; fills names and ns per call of each pattern */
+static void Run(const char *binary, int window, int generic, int messages,
+                char names[PATTERNS][16], double ns[PATTERNS])
+{
+  char command[256], line[256];
+  int n = 0;
+  FILE *fp;
+
+  snprintf(command, sizeof(command), "WINDOW=%d FASTPATH=%s %s %d", window,
+           generic ? "generic" : "specialised", binary, messages);
+  fp = popen(command, "r");
+  if (fp == NULL)
+    exit(EXIT_FAILURE);
+  while (fgets(line, sizeof(line), fp) != NULL && n < PATTERNS)
+    if (sscanf(line, "%15s %lf ns/call", names[n], &ns[n]) == 2)
+      n++;
+  pclose(fp);
+  if (n != PATTERNS) {
+    printf("unexpected output from %s\n", command);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const char *protocol = argc > 1 ? argv[1] : "sr";
+  int messages = argc > 2 ? atoi(argv[2]) : 200000;
+  int gbn = strcmp(protocol, "gbn") == 0;
+  char prefix[64], command[512], objects[512] = "";
+  int i, j;
+
+  if (!gbn && strcmp(protocol, "sr") != 0) {
+    printf("usage: fastbench [sr|gbn] [messages]\n");
+    return EXIT_FAILURE;
+  }
+  snprintf(prefix, sizeof(prefix), "/tmp/fastbench-%d-%s", (int)getpid(), protocol);
+
+  for (i = 0; i < NWINDOWS; i++) {
+    char seqspace[32] = "";
+    int w = windows[i];
+    if (gbn)
+      snprintf(seqspace, sizeof(seqspace), "-DSEQSPACE=%d", 2 * w);
+    snprintf(command, sizeof(command),
+             "gcc %s -c -DWINDOWSIZE=%d %s -DPROTOCOL_PREFIX=w%d_ %s.c -o %s_w%d.o",
+             CFLAGS, w, seqspace, w, protocol, prefix, w);
+    Build(command);
+    snprintf(objects + strlen(objects), sizeof(objects) - strlen(objects), " %s_w%d.o", prefix, w);
+  }
+  snprintf(command, sizeof(command),
+           "gcc %s -c -DGENERIC_WINDOW -DPROTOCOL_PREFIX=generic_ %s.c -o %s_generic.o",
+           CFLAGS, protocol, prefix);
+  Build(command);
+  snprintf(objects + strlen(objects), sizeof(objects) - strlen(objects), " %s_generic.o", prefix);
+  snprintf(command, sizeof(command), "gcc %s bench.c fastpath.c%s -o %s", CFLAGS, objects, prefix);
+  Build(command);
+
+  printf("%s, %d messages per pattern, ns per call\n", protocol, messages);
+  printf("window  pattern     specialised   generic  speedup\n");
+  for (i = 0; i < NWINDOWS; i++) {
+    char names[PATTERNS][16];
+    double fast[PATTERNS], slow[PATTERNS];
+    Run(prefix, windows[i], 0, messages, names, fast);
+    Run(prefix, windows[i], 1, messages, names, slow);
+    for (j = 0; j < PATTERNS; j++)
+      printf("%6d  %-10s  %11.1f  %8.1f  %6.2fx\n", windows[i], names[j], fast[j], slow[j],
+             slow[j] / fast[j]);
+  }
+
+  remove(prefix);
+  for (i = 0; i < NWINDOWS; i++) {
+    snprintf(command, sizeof(command), "%s_w%d.o", prefix, windows[i]);
+    remove(command);
+  }
+  snprintf(command, sizeof(command), "%s_generic.o", prefix);
+  remove(command);
+  return EXIT_SUCCESS;
+}
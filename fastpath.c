@@ -0,0 +1,138 @@
+/**********************************************************************
+   Protocol handlers specialised for common window sizes
+
+   sr.c (or gbn.c) is built once for each window in SPECIALISED.  In
+   those builds the window is a compile-time constant and the sequence
+   space a power of two, so every sequence number step folds its modulo
+   into a mask and the loops over the window get constant bounds.  It is
+   also built once with -DGENERIC_WINDOW, where the window is a variable.
+   This file provides the entry points the emulator calls.  A_init()
+   picks the build for the window in the environment variable WINDOW
+   (default 6), or the generic build for any other window;
+   FASTPATH=generic forces the generic build.
+
+   Build from the directory holding the protocol sources (for gbn.c,
+   add -DSEQSPACE=$((2*w)) to the specialised builds):
+     for w in 8 128 1024; do
+       gcc -O2 -c -DWINDOWSIZE=$w -DPROTOCOL_PREFIX=w${w}_ sr.c -o sr_w$w.o
+     done
+     gcc -O2 -c -DGENERIC_WINDOW -DPROTOCOL_PREFIX=generic_ sr.c -o sr_generic.o
+     gcc -O2 emulator.c fastpath.c sr_w*.o sr_generic.o -o sr_fast -lm
+     WINDOW=128 ./sr_fast
+   fastbench.c does this and times the builds against each other.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "fastpath.h"
+#include "sr.h"
+
+#define SPECIALISED(X) X(8) X(128) X(1024)
+
+struct handlers {
+  int window;               /* 0 = generic */
+  void (*A_init)(void);
+  void (*B_init)(void);
+  void (*A_input)(struct pkt);
+  void (*B_input)(struct pkt);
+  void (*A_output)(struct msg);
+  void (*A_output_zc)(struct msg *, sendcomplete);
+  void (*B_output)(struct msg);
+  void (*A_timerinterrupt)(void);
+  void (*B_timerinterrupt)(void);
+};
+
+#define DECLARE(prefix)                                                  \
+  extern void prefix##A_init(void);                                      \
+  extern void prefix##B_init(void);                                      \
+  extern void prefix##A_input(struct pkt);                               \
+  extern void prefix##B_input(struct pkt);                               \
+  extern void prefix##A_output(struct msg);                              \
+  extern void prefix##A_output_zc(struct msg *, sendcomplete);           \
+  extern void prefix##B_output(struct msg);                              \
+  extern void prefix##A_timerinterrupt(void);                            \
+  extern void prefix##B_timerinterrupt(void);
+#define ENTRY(window, prefix)                                            \
+  { window, prefix##A_init, prefix##B_init, prefix##A_input, prefix##B_input, \
+    prefix##A_output, prefix##A_output_zc, prefix##B_output,             \
+    prefix##A_timerinterrupt, prefix##B_timerinterrupt }
+#define DECLARE_WINDOW(n) DECLARE(w##n##_)
+#define ENTRY_WINDOW(n) ENTRY(n, w##n##_),
+
+SPECIALISED(DECLARE_WINDOW)
+DECLARE(generic_)
+
+static const struct handlers specialised[] = { SPECIALISED(ENTRY_WINDOW) };
+static const struct handlers generic = ENTRY(0, generic_);
+static const struct handlers *active;
+
+/* choose the handlers for the window asked for, once */
+static void Select(void)
+{
+  const char *window = getenv("WINDOW");
+  const char *mode = getenv("FASTPATH");
+  int i, w = window != NULL ? atoi(window) : 6;
+
+  if (active != NULL)
+    return;
+  if (w < 1 || w > MAXWINDOW) {
+    printf("fastpath: window %d is outside 1..%d\n", w, MAXWINDOW);
+    exit(EXIT_FAILURE);
+  }
+  active = &generic;
+  protocol_window = w;
+  if (mode == NULL || strcmp(mode, "generic") != 0)
+    for (i = 0; i < (int)(sizeof(specialised) / sizeof(specialised[0])); i++)
+      if (specialised[i].window == w)
+        active = &specialised[i];
+  if (TRACE > 0)
+    printf("fastpath: window %d, %s handlers\n", w, active->window ? "specialised" : "generic");
+}
+
+void A_init(void)
+{
+  Select();
+  active->A_init();
+}
+
+void B_init(void)
+{
+  Select();
+  active->B_init();
+}
+
+void A_input(struct pkt packet)
+{
+  active->A_input(packet);
+}
+
+void B_input(struct pkt packet)
+{
+  active->B_input(packet);
+}
+
+void A_output(struct msg message)
+{
+  active->A_output(message);
+}
+
+void A_output_zc(struct msg *message, sendcomplete done)
+{
+  active->A_output_zc(message, done);
+}
+
+void B_output(struct msg message)
+{
+  active->B_output(message);
+}
+
+void A_timerinterrupt(void)
+{
+  active->A_timerinterrupt();
+}
+
+void B_timerinterrupt(void)
+{
+  active->B_timerinterrupt();
+}
@@ -0,0 +1,31 @@
+/* Builds of sr.c or gbn.c for fastpath.c.
+
+   -DGENERIC_WINDOW makes the window the variable protocol_window, set
+   before A_init(), up to MAXWINDOW; the arrays are sized for MAXWINDOW.
+   -DPROTOCOL_PREFIX=name_ renames the entry points name_A_init and so
+   on, so that several builds of one protocol, each with its own window,
+   link into one program. */
+
+#define MAXWINDOW 1024    /* largest window of the generic build */
+
+extern int protocol_window;
+
+#ifdef GENERIC_WINDOW
+#define WINDOWSIZE protocol_window
+#endif
+
+#ifdef PROTOCOL_PREFIX
+#define FASTPATH_CAT2(prefix, name) prefix##name
+#define FASTPATH_CAT(prefix, name) FASTPATH_CAT2(prefix, name)
+#define A_init FASTPATH_CAT(PROTOCOL_PREFIX, A_init)
+#define B_init FASTPATH_CAT(PROTOCOL_PREFIX, B_init)
+#define A_input FASTPATH_CAT(PROTOCOL_PREFIX, A_input)
+#define B_input FASTPATH_CAT(PROTOCOL_PREFIX, B_input)
+#define A_output FASTPATH_CAT(PROTOCOL_PREFIX, A_output)
+#define A_output_zc FASTPATH_CAT(PROTOCOL_PREFIX, A_output_zc)
+#define B_output FASTPATH_CAT(PROTOCOL_PREFIX, B_output)
+#define A_timerinterrupt FASTPATH_CAT(PROTOCOL_PREFIX, A_timerinterrupt)
+#define B_timerinterrupt FASTPATH_CAT(PROTOCOL_PREFIX, B_timerinterrupt)
+#define ComputeChecksum FASTPATH_CAT(PROTOCOL_PREFIX, ComputeChecksum)
+#define IsCorrupted FASTPATH_CAT(PROTOCOL_PREFIX, IsCorrupted)
+#endif
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "emulator.h"
+#if defined(PROTOCOL_PREFIX) || defined(GENERIC_WINDOW)
+#include "fastpath.h"
+#endif
 #include "gbn.h"
 
 /* ******************************************************************
@@ -22,11 +25,40 @@
    - added GBN implementation
 **********************************************************************/
 
+/* RTT and WINDOWSIZE may be given on the compiler command line (-D), the tuner does,
+   and fastpath.c builds one copy per common window plus a generic one (fastpath.h).
+   SEQSPACE may be given too, any value above WINDOWSIZE works */
+#ifndef RTT
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#endif
+#ifndef WINDOWSIZE
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
+#endif
+#define GBN_CACHE 0     /* out-of-order packets B holds until the gap before them is filled,
+                           0 = discard them; A then resends only what B cannot be holding.
+                           More than WINDOWSIZE - 1 is never used */
+#ifndef SEQSPACE
+#define SEQSPACE (WINDOWSIZE + GBN_CACHE + 1) /* the min sequence space for GBN must be at least windowsize + 1,
+                                                 and windowsize + 1 more for each packet B may hold */
+#endif
+#ifdef GENERIC_WINDOW
+#define WINDOWSLOTS MAXWINDOW
+int protocol_window = 6;
+#else
+#define WINDOWSLOTS WINDOWSIZE /* entries of the window arrays */
+#endif
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define ADAPTIVE_RTO 0  /* 1 = time out after the RTO estimated from timestamp RTT samples, 0 = fixed RTT */
+#define MINRTO 2.0      /* lower bound on the estimated RTO */
+#define MAXRTO 64.0     /* upper bound on the estimated RTO */
+#define TLP 0           /* 1 = send a tail loss probe when the window goes quiet before the RTO */
+#define CONGESTION 0    /* 0 = fixed window, 1 = AIMD window halved on timeouts,
+                           2 = AIMD window also halved on ECN echoes, before any loss */
+
+/* how far past expectedseqnum B holds packets: no further than GBN_CACHE, and not so far
+   that a new packet shares its sequence number with an old duplicate from the window before */
+#define CACHEREACH (GBN_CACHE < SEQSPACE - WINDOWSIZE - 1 ? GBN_CACHE : SEQSPACE - WINDOWSIZE - 1)
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
@@ -40,6 +72,7 @@ int ComputeChecksum(struct pkt packet)
 
   checksum = packet.seqnum;
   checksum += packet.acknum;
+  checksum += packet.flags & ~PKT_ECNMASK;  /* the channel may set ECN bits */
   for ( i=0; i<20; i++ )
     checksum += (int)(packet.payload[i]);
 
@@ -57,10 +90,147 @@ bool IsCorrupted(struct pkt packet)
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
+static struct pkt buffer[WINDOWSLOTS];  /* array for storing packets waiting for ACK */
 static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
 static int windowcount;                /* the number of packets currently awaiting an ACK */
 static int A_nextseqnum;               /* the next sequence number to be used by the sender */
+static float srtt;                     /* smoothed RTT from timestamp samples */
+static float rttvar;                   /* RTT variation from timestamp samples */
+static float rto;                      /* timeout used when starting the timer */
+static float rto_deadline;             /* time the retransmission timeout for the window expires */
+static bool probe_pending;             /* a tail loss probe may still be sent before rto_deadline */
+static float deadline[WINDOWSLOTS];     /* time after which buffer[i] is abandoned, 0.0 = never */
+static int forwardseq;                 /* seqnum B is being asked to skip to, or NOTINUSE */
+static int forwardfrom;                /* first abandoned seqnum B is being asked to skip */
+static float cwnd;                     /* congestion window, never above WINDOWSIZE */
+static float recovery_end;             /* no further window reduction before this time */
+static bool recovering;                /* a timeout resent the front of the window, GBN_CACHE only */
+static int recoverfrom;                /* seqnum at the front of the window at that timeout */
+static int recoverto;                  /* seqnum at the back of the window at that timeout */
+
+/* take an RTT sample from the timestamp echoed in an ACK and update the RTO estimate.
+   Duplicate ACKs echo the timestamp of the packet that triggered them, so every ACK
+   gives a valid sample. */
+static void SampleRTT(struct pkt packet)
+{
+  float sample;
+
+  /* the receiver echoes NOTINUSE when it could not trust the timestamp */
+  if (packet.timestamp < 0.0)
+    return;
+  sample = currenttime() - packet.timestamp;
+  record_rtt(sample);
+
+  if (srtt == 0.0) {
+    srtt = sample;
+    rttvar = sample / 2;
+  }
+  else {
+    rttvar = 0.75 * rttvar + 0.25 * (srtt > sample ? srtt - sample : sample - srtt);
+    srtt = 0.875 * srtt + 0.125 * sample;
+  }
+  if (ADAPTIVE_RTO) {
+    rto = srtt + 4 * rttvar;
+    if (rto < MINRTO) rto = MINRTO;
+    if (rto > MAXRTO) rto = MAXRTO;
+  }
+}
+
+/* halve the congestion window, at most once per round trip */
+static void ReduceWindow(void)
+{
+  if (currenttime() < recovery_end)
+    return;
+  cwnd = cwnd / 2;
+  if (cwnd < 1.0)
+    cwnd = 1.0;
+  recovery_end = currenttime() + (srtt > 0.0 ? srtt : rto);
+  window_reductions++;
+  if (TRACE > 0)
+    printf("----A: reducing congestion window to %f\n", cwnd);
+}
+
+/* probe timeout for TLP: two smoothed RTTs, or half the RTO before the first sample */
+static float ProbeTimeout(void)
+{
+  if (srtt > 0.0)
+    return 2 * srtt;
+  else
+    return rto / 2;
+}
+
+/* start A's timer for a fresh retransmission timeout.  With TLP the timer
+   first fires after the shorter probe timeout. */
+static void StartTimer(void)
+{
+  rto_deadline = currenttime() + rto;
+  probe_pending = TLP;
+  if (TLP && ProbeTimeout() < rto)
+    starttimer(A, ProbeTimeout());
+  else
+    starttimer(A, rto);
+}
+
+/* new data went out: push the tail loss probe back, as the window is not quiet yet */
+static void DelayProbe(void)
+{
+  float remaining = rto_deadline - currenttime();
+
+  stoptimer(A);
+  if (ProbeTimeout() < remaining)
+    starttimer(A, ProbeTimeout());
+  else
+    starttimer(A, remaining);
+}
+
+/* drop expired packets from the front of the window and ask B to skip past them */
+static void AbandonExpired(void)
+{
+  struct pkt fwdpkt;
+  int i;
+  bool expired = false;
+
+  while (windowcount > 0 && deadline[windowfirst] > 0.0 && currenttime() >= deadline[windowfirst]) {
+    if (!expired && forwardseq == NOTINUSE)
+      forwardfrom = buffer[windowfirst].seqnum;
+    if (TRACE > 0)
+      printf("----A: lifetime of packet %d expired, abandoning it\n", buffer[windowfirst].seqnum);
+    windowfirst = (windowfirst + 1) % WINDOWSIZE;
+    windowcount--;
+    messages_abandoned++;
+    expired = true;
+  }
+  if (expired) {
+    if (windowcount > 0)
+      forwardseq = buffer[windowfirst].seqnum;
+    else
+      forwardseq = A_nextseqnum;
+  }
+  if (forwardseq == NOTINUSE)
+    return;
+
+  /* (re)send the forward-skip until B confirms it */
+  if (TRACE > 0)
+    printf("----A: sending forward-skip to %d\n", forwardseq);
+  fwdpkt.seqnum = forwardseq;
+  fwdpkt.acknum = forwardfrom;
+  fwdpkt.flags = PKT_FORWARD;
+  for ( i=0; i<20 ; i++ )
+    fwdpkt.payload[i] = '0';
+  fwdpkt.checksum = ComputeChecksum(fwdpkt);
+  fwdpkt.timestamp = currenttime();
+  fwdpkt.msgtime = currenttime();
+  fwdpkt.path = 0;
+  fwdpkt.stream = 0;
+  fwdpkt.streamseq = 0;
+  fwdpkt.hdrchecksum = 0;
+  fwdpkt.parity = 0;
+  fwdpkt.receiver = 0;
+  fwdpkt.nonce = 0;
+  for ( i=0; i<16 ; i++ )
+    fwdpkt.tag[i] = 0;
+  tolayer3(A, fwdpkt);
+}
 
 /* called from layer 5 (application layer), passed the message to be sent to other side */
 void A_output(struct msg message)
@@ -68,22 +238,36 @@ void A_output(struct msg message)
   struct pkt sendpkt;
   int i;
 
-  /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
+  /* if not blocked waiting on ACK.  While a forward-skip is outstanding B may still
+     expect an abandoned packet, so new sequence numbers could be mistaken for old ones */
+  if ( windowcount < WINDOWSIZE && windowcount < (int)cwnd && forwardseq == NOTINUSE) {
     if (TRACE > 1)
       printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
 
     /* create packet */
     sendpkt.seqnum = A_nextseqnum;
     sendpkt.acknum = NOTINUSE;
+    sendpkt.flags = (CONGESTION == 2) ? PKT_ECT : 0;
     for ( i=0; i<20 ; i++ )
       sendpkt.payload[i] = message.data[i];
     sendpkt.checksum = ComputeChecksum(sendpkt);
+    sendpkt.timestamp = currenttime();
+    sendpkt.msgtime = currenttime();
+    sendpkt.path = 0;   /* GBN keeps to one path, reordering across paths would cost it whole windows */
+    sendpkt.stream = 0; /* and carries a single stream */
+    sendpkt.streamseq = 0;
+    sendpkt.hdrchecksum = 0;  /* GBN checks a packet whole */
+    sendpkt.parity = 0;
+    sendpkt.receiver = 0;     /* and serves one receiver */
+    sendpkt.nonce = 0;        /* nor does it encrypt */
+    for ( i=0; i<16 ; i++ )
+      sendpkt.tag[i] = 0;
 
     /* put packet in window buffer */
     /* windowlast will always be 0 for alternating bit; but not for GoBackN */
     windowlast = (windowlast + 1) % WINDOWSIZE;
     buffer[windowlast] = sendpkt;
+    deadline[windowlast] = message.lifetime > 0.0 ? currenttime() + message.lifetime : 0.0;
     windowcount++;
 
     /* send out packet */
@@ -93,7 +277,9 @@ void A_output(struct msg message)
 
     /* start timer if first packet in window */
     if (windowcount == 1)
-      starttimer(A,RTT);
+      StartTimer();
+    else if (TLP && probe_pending)
+      DelayProbe();
 
     /* get next sequence number, wrap back to 0 */
     A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;
@@ -120,6 +306,21 @@ void A_input(struct pkt packet)
     if (TRACE > 0)
       printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
     total_ACKs_received++;
+    SampleRTT(packet);
+
+    /* the channel marked one of our packets: back off before it has to drop */
+    if (CONGESTION == 2 && (packet.flags & PKT_ECE))
+      ReduceWindow();
+
+    /* B confirmed the forward-skip */
+    if (packet.flags & PKT_FORWARD) {
+      if (packet.acknum == forwardseq) {
+        forwardseq = NOTINUSE;
+        if (windowcount == 0)
+          stoptimer(A);
+      }
+      return;
+    }
 
     /* check if new ACK or duplicate */
     if (windowcount != 0) {
@@ -134,6 +335,9 @@ void A_input(struct pkt packet)
               printf("----A: ACK %d is not a duplicate\n",packet.acknum);
             new_ACKs++;
 
+            /* B is past the front of the window, so it has acted on any forward-skip */
+            forwardseq = NOTINUSE;
+
             /* cumulative acknowledgement - determine how many packets are ACKed */
             if (packet.acknum >= seqfirst)
               ackcount = packet.acknum + 1 - seqfirst;
@@ -147,10 +351,32 @@ void A_input(struct pkt packet)
             for (i=0; i<ackcount; i++)
               windowcount--;
 
+            /* additive increase: about one packet per window of ACKs */
+            if (CONGESTION > 0 && cwnd < WINDOWSIZE) {
+              cwnd += ackcount / cwnd;
+              if (cwnd > WINDOWSIZE)
+                cwnd = WINDOWSIZE;
+            }
+
 	    /* start timer again if there are still more unacked packets in window */
             stoptimer(A);
             if (windowcount > 0)
-              starttimer(A, RTT);
+              StartTimer();
+
+            /* B delivered what it held up to the next gap: fill that gap now, unless the
+               timeout resent it already, and leave what B may be holding after it */
+            if (GBN_CACHE > 0 && recovering) {
+              int front = buffer[windowfirst].seqnum;
+              if (windowcount == 0 || (recoverto + SEQSPACE - front) % SEQSPACE >= windowcount)
+                recovering = false;
+              else if ((front + SEQSPACE - recoverfrom) % SEQSPACE <= CACHEREACH) {
+                if (TRACE > 0)
+                  printf("----A: partial ACK, resending packet %d\n", front);
+                buffer[windowfirst].timestamp = currenttime();
+                tolayer3(A, buffer[windowfirst]);
+                packets_resent++;
+              }
+            }
 
           }
         }
@@ -168,17 +394,48 @@ void A_timerinterrupt(void)
 {
   int i;
 
+  /* window went quiet: resend only the last packet to provoke an ACK for the tail */
+  if (TLP && probe_pending && currenttime() < rto_deadline) {
+    probe_pending = false;
+    if (TRACE > 0)
+      printf("----A: window is quiet, sending tail loss probe %d\n", buffer[windowlast].seqnum);
+    buffer[windowlast].timestamp = currenttime();
+    tolayer3(A, buffer[windowlast]);
+    packets_resent++;
+    tlp_probes++;
+    starttimer(A, rto_deadline - currenttime());
+    return;
+  }
+  probe_pending = false;
+
   if (TRACE > 0)
     printf("----A: time out,resend packets!\n");
 
+  if (CONGESTION > 0)
+    ReduceWindow();
+  AbandonExpired();
+  if (windowcount == 0 && forwardseq != NOTINUSE)
+    starttimer(A,rto);
+
+  if (GBN_CACHE > 0 && windowcount > 0) {
+    recovering = true;
+    recoverfrom = buffer[windowfirst].seqnum;
+    recoverto = buffer[windowlast].seqnum;
+  }
+
   for(i=0; i<windowcount; i++) {
 
+    /* B may be holding these, a partial ACK will tell */
+    if (i > 0 && i <= CACHEREACH)
+      continue;
+
     if (TRACE > 0)
       printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
 
+    buffer[(windowfirst+i) % WINDOWSIZE].timestamp = currenttime();
     tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
     packets_resent++;
-    if (i==0) starttimer(A,RTT);
+    if (i==0) starttimer(A,rto);
   }
 }
 
@@ -196,6 +453,14 @@ void A_init(void)
 		     so initially this is set to -1
 		   */
   windowcount = 0;
+  srtt = 0.0;
+  rttvar = 0.0;
+  rto = RTT;
+  probe_pending = false;
+  forwardseq = NOTINUSE;
+  cwnd = WINDOWSIZE;
+  recovery_end = 0.0;
+  recovering = false;
 }
 
 
@@ -204,6 +469,17 @@ void A_init(void)
 
 static int expectedseqnum; /* the sequence number expected next by the receiver */
 static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
+static struct pkt cache[GBN_CACHE + 1]; /* out-of-order packets, cache[cachefirst] is for expectedseqnum */
+static bool cached[GBN_CACHE + 1];      /* cache[i] holds a packet */
+static int cachefirst;
+
+/* pass one in-order packet to layer 5 */
+static void Deliver(struct pkt *packet)
+{
+  packets_received++;
+  tolayer5(B, packet->payload);
+  record_latency(0, currenttime() - packet->msgtime);
+}
 
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
@@ -211,30 +487,83 @@ void B_input(struct pkt packet)
 {
   struct pkt sendpkt;
   int i;
-
+  int distance;
+
+  sendpkt.flags = 0;
+
+  /* forward-skip: A abandoned the packets before seqnum */
+  if (!IsCorrupted(packet) && (packet.flags & PKT_FORWARD)) {
+    /* act only if B is still inside the abandoned range, a late forward-skip must not
+       move it back */
+    distance = (packet.seqnum + SEQSPACE - expectedseqnum) % SEQSPACE;
+    if ((expectedseqnum + SEQSPACE - packet.acknum) % SEQSPACE
+        < (packet.seqnum + SEQSPACE - packet.acknum) % SEQSPACE) {
+      if (TRACE > 0)
+        printf("----B: skipping from %d to %d\n", expectedseqnum, packet.seqnum);
+      messages_skipped += distance;
+      expectedseqnum = packet.seqnum;
+      /* what B held was placed relative to the old expectedseqnum, A will resend it */
+      for (i = 0; i <= GBN_CACHE; i++)
+        cached[i] = false;
+    }
+    /* confirm the forward-skip, even if it was a duplicate */
+    sendpkt.acknum = packet.seqnum;
+    sendpkt.flags = PKT_FORWARD;
+    sendpkt.timestamp = packet.timestamp;
+  }
   /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
+  else if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
     if (TRACE > 0)
       printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
 
     /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
-
-    /* update state variables */
+    Deliver(&packet);
     expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+
+    /* then the run of packets held behind it */
+    if (GBN_CACHE > 0) {
+      cachefirst = (cachefirst + 1) % (GBN_CACHE + 1);
+      while (cached[cachefirst]) {
+        if (TRACE > 0)
+          printf("----B: delivering held packet %d\n", expectedseqnum);
+        Deliver(&cache[cachefirst]);
+        cached[cachefirst] = false;
+        expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+        cachefirst = (cachefirst + 1) % (GBN_CACHE + 1);
+      }
+    }
+
+    /* send a cumulative ACK for everything delivered, echoing any congestion mark */
+    sendpkt.acknum = (expectedseqnum + SEQSPACE - 1) % SEQSPACE;
+    if (packet.flags & PKT_CE)
+      sendpkt.flags |= PKT_ECE;
+    sendpkt.timestamp = packet.timestamp;
   }
   else {
     /* packet is corrupted or out of order resend last ACK */
     if (TRACE > 0)
       printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
+
+    /* hold an out-of-order packet B can tell from an old duplicate */
+    distance = (packet.seqnum + SEQSPACE - expectedseqnum) % SEQSPACE;
+    if (GBN_CACHE > 0 && !IsCorrupted(packet) && distance <= CACHEREACH
+        && !cached[(cachefirst + distance) % (GBN_CACHE + 1)]) {
+      if (TRACE > 0)
+        printf("----B: holding packet %d until %d arrives\n", packet.seqnum, expectedseqnum);
+      cache[(cachefirst + distance) % (GBN_CACHE + 1)] = packet;
+      cached[(cachefirst + distance) % (GBN_CACHE + 1)] = true;
+      packets_cached++;
+    }
     if (expectedseqnum == 0)
       sendpkt.acknum = SEQSPACE - 1;
     else
       sendpkt.acknum = expectedseqnum - 1;
+
+    /* echo the timestamp of an uncorrupted duplicate, it still times that transmission */
+    if (IsCorrupted(packet))
+      sendpkt.timestamp = NOTINUSE;
+    else
+      sendpkt.timestamp = packet.timestamp;
   }
 
   /* create packet */
@@ -244,6 +573,16 @@ void B_input(struct pkt packet)
   /* we don't have any data to send.  fill payload with 0's */
   for ( i=0; i<20 ; i++ )
     sendpkt.payload[i] = '0';
+  sendpkt.msgtime = packet.msgtime;
+  sendpkt.path = packet.path;
+  sendpkt.stream = 0;
+  sendpkt.streamseq = 0;
+  sendpkt.hdrchecksum = 0;
+  sendpkt.parity = 0;
+  sendpkt.receiver = 0;
+  sendpkt.nonce = 0;
+  for ( i=0; i<16 ; i++ )
+    sendpkt.tag[i] = 0;
 
   /* computer checksum */
   sendpkt.checksum = ComputeChecksum(sendpkt);
@@ -256,8 +595,13 @@ void B_input(struct pkt packet)
 /* entity B routines are called. You can use it to do any initialization */
 void B_init(void)
 {
+  int i;
+
   expectedseqnum = 0;
   B_nextseqnum = 1;
+  cachefirst = 0;
+  for (i = 0; i <= GBN_CACHE; i++)
+    cached[i] = false;
 }
 
 /******************************************************************************
@@ -265,6 +609,13 @@ void B_init(void)
  *****************************************************************************/
 
 /* Note that with simplex transfer from a-to-B, there is no B_output() */
+/* zero-copy send: GBN copies every message into its window, so it hands it back at once */
+void A_output_zc(struct msg *message, sendcomplete done)
+{
+  A_output(*message);
+  done(message);
+}
+
 void B_output(struct msg message)
 {
 }
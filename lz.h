@@ -0,0 +1,132 @@
+/* LZ4-class block compressor for coalesced packet payloads.
+
+   The output is a run of LZ4-style sequences: a token whose high nibble
+   is the literal count and low nibble the match length less LZMINMATCH
+   (15 in either means more length bytes follow, each adding up to 255),
+   the literals, then the match offset.  Blocks are a few hundred bytes
+   at most, so the offset is one byte (matches reach back LZWINDOW) and
+   there is no end-of-block margin: the block simply ends after the
+   literals of its last sequence, or after its last match.
+
+   One hash table probe per position, no match search chains: speed over
+   ratio, as LZ4 does.  Everything is static so the header can be
+   included by sr.c without another file to link. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZMINMATCH 4      /* shortest match worth a sequence */
+#define LZWINDOW 255      /* farthest a match reaches back, one byte of offset */
+#define LZHASHBITS 8      /* log2 of the hash table entries */
+
+/* the length bytes after a nibble of 15; returns the new output position, -1 if full */
+static int LzLength(uint8_t *out, int o, int cap, int len)
+{
+  for (len -= 15; len >= 255; len -= 255) {
+    if (o >= cap)
+      return -1;
+    out[o++] = 255;
+  }
+  if (o >= cap)
+    return -1;
+  out[o++] = (uint8_t)len;
+  return o;
+}
+
+/* one sequence: nlit literals, then a match of mlen bytes offset back, or none if offset is 0 */
+static int LzSequence(uint8_t *out, int o, int cap, const uint8_t *lit, int nlit,
+                      int offset, int mlen)
+{
+  int mcode = offset == 0 ? 0 : mlen - LZMINMATCH;
+
+  if (o >= cap)
+    return -1;
+  out[o++] = (uint8_t)((nlit < 15 ? nlit : 15) << 4 | (mcode < 15 ? mcode : 15));
+  if (nlit >= 15 && (o = LzLength(out, o, cap, nlit)) < 0)
+    return -1;
+  if (o + nlit > cap)
+    return -1;
+  memcpy(out + o, lit, nlit);
+  o += nlit;
+  if (offset == 0)
+    return o;
+  if (o >= cap)
+    return -1;
+  out[o++] = (uint8_t)offset;
+  if (mcode >= 15 && (o = LzLength(out, o, cap, mcode)) < 0)
+    return -1;
+  return o;
+}
+
+/* compress n bytes into at most cap; returns the compressed size, or -1 if it does not fit */
+static int LzCompress(const uint8_t *in, int n, uint8_t *out, int cap)
+{
+  int16_t table[1 << LZHASHBITS];
+  int anchor = 0, i = 0, o = 0;
+
+  memset(table, 0xff, sizeof(table));   /* -1: no earlier position */
+  while (i + LZMINMATCH <= n) {
+    uint32_t v, h;
+    int cand;
+
+    memcpy(&v, in + i, sizeof(v));
+    h = (v * 2654435761u) >> (32 - LZHASHBITS);
+    cand = table[h];
+    table[h] = (int16_t)i;
+    if (cand >= 0 && i - cand <= LZWINDOW && memcmp(in + cand, in + i, LZMINMATCH) == 0) {
+      int len = LZMINMATCH;
+      while (i + len < n && in[cand + len] == in[i + len])
+        len++;              /* may overlap position i: a run repeats itself */
+      o = LzSequence(out, o, cap, in + anchor, i - anchor, i - cand, len);
+      if (o < 0)
+        return -1;
+      i += len;
+      anchor = i;
+    } else {
+      i++;
+    }
+  }
+  if (anchor < n || n == 0)
+    o = LzSequence(out, o, cap, in + anchor, n - anchor, 0, 0);
+  return o;
+}
+
+/* decompress n bytes into at most cap; returns the size, or -1 if the block is malformed */
+static int LzDecompress(const uint8_t *in, int n, uint8_t *out, int cap)
+{
+  int i = 0, o = 0;
+
+  while (i < n) {
+    int token = in[i++], nlit = token >> 4, mlen = token & 15, offset;
+
+    if (nlit == 15)
+      do {
+        if (i >= n)
+          return -1;
+        nlit += in[i];
+      } while (in[i++] == 255);
+    if (i + nlit > n || o + nlit > cap)
+      return -1;
+    memcpy(out + o, in + i, nlit);
+    i += nlit;
+    o += nlit;
+    if (i == n)
+      break;                /* the last sequence need not have a match */
+
+    offset = in[i++];
+    if (offset == 0 || offset > o)
+      return -1;
+    if (mlen == 15)
+      do {
+        if (i >= n)
+          return -1;
+        mlen += in[i];
+      } while (in[i++] == 255);
+    mlen += LZMINMATCH;
+    if (o + mlen > cap)
+      return -1;
+    for (; mlen > 0; mlen--, o++)
+      out[o] = out[o - offset];   /* byte by byte, the match may overlap its own output */
+  }
+  return o;
+}
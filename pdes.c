@@ -0,0 +1,449 @@
+/**********************************************************************
+   Conservative parallel discrete-event simulation of many SR flows
+
+   The emulator's main() takes one event at a time off a single list.
+   This engine simulates a larger topology, a ring of NROUTERS routers
+   with FLOWSPERROUTER flows starting at each, in parallel.  Flow f
+   starts at router f / FLOWSPERROUTER and ends HOPS routers further
+   round the ring; its ACKs come back the other way.  Every router has
+   a link to each neighbour, shared by all the flows crossing it, and a
+   packet arrives 1 to 10 time units after the previous one on its link,
+   lost with probability LOSS, like the emulator's channel.  A link
+   carries about one packet per 5.5 time units, which the defaults keep
+   below.  The flows are a model of sr.c: a fixed window,
+   selective ACKs and one timer per sender, and a receive window.
+
+   Each router is a logical process (LP) with its own event queue
+   order and random numbers, and the routers are split into contiguous
+   blocks, one per thread.  A packet spends at least 1 time unit on a
+   link (the "1 +" in tolayer3()), so that is the lookahead: the threads
+   agree on the earliest pending event W, each processes its events
+   before W + 1, and packets for other threads (which cannot arrive
+   before W + 1) are exchanged at a barrier before the next window.
+
+   Events are ordered by (time, creating LP, number of events that LP
+   created before), which does not depend on the partition, so every
+   thread count gives exactly the results of the sequential engine.
+   The program checks this.
+
+   Build and run:
+     gcc -O2 pdes.c -o pdes -lpthread -lm
+     ./pdes [threads ...]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#define NROUTERS 4096
+#define FLOWSPERROUTER 1
+#define NFLOWS (NROUTERS * FLOWSPERROUTER)
+#define HOPS 4            /* routers from a flow's sender to its receiver */
+#define MESSAGES 200      /* messages per flow */
+#define LAMBDA 50.0       /* average time between messages of a flow */
+#define LOSS 0.02         /* loss probability per link */
+#define WINDOWSIZE 6
+#define RTT 80.0          /* retransmission timeout, longer than the path's RTT */
+#define LOOKAHEAD 1.0     /* least time a packet spends on a link */
+#define MAXTHREADS 64
+
+#define MESSAGE 0         /* a message reaches the sender of flow */
+#define TIMEOUT 1         /* the sender's timer, if still generation gen */
+#define PACKET  2         /* a data packet (ack 0) or an ACK (ack 1) reaches a router */
+
+struct event {
+  double time;
+  int src;                /* LP that created the event */
+  unsigned order;         /* events src created before this one */
+  int lp;                 /* LP the event happens at */
+  int type;
+  int flow;
+  int seqnum;
+  int ack;
+  int gen;
+};
+
+/* a binary heap of events, earliest first */
+struct heap {
+  struct event *e;
+  int size, cap;
+};
+
+/* a list of events created by one thread for another */
+struct outbox {
+  struct event *e;
+  int size, cap;
+};
+
+/* state of each router (LP) */
+static uint64_t rng[NROUTERS];
+static unsigned created[NROUTERS];      /* events the LP has created */
+static double linklast[2][NROUTERS];    /* arrival time of the last packet on the link to the
+                                           next router [0] and to the previous one [1] */
+static long processed[NROUTERS];        /* events the LP has handled */
+
+/* sender state of each flow, owned by its first router */
+static int msgsleft[NFLOWS], base[NFLOWS], nextseq[NFLOWS];
+static uint32_t acked[NFLOWS];
+static int timergen[NFLOWS];            /* bumped to cancel the pending timeout */
+static int timerset[NFLOWS];
+static int resent[NFLOWS], dropped[NFLOWS];
+/* receiver state of each flow, owned by its last router */
+static int expected[NFLOWS];
+static uint32_t received[NFLOWS];
+static int delivered[NFLOWS];
+static double finish[NFLOWS];
+
+static int nthreads;
+static struct heap heaps[MAXTHREADS];
+static struct outbox outboxes[MAXTHREADS][MAXTHREADS];   /* [from][to] */
+static double nexttime[MAXTHREADS];
+static pthread_barrier_t barrier;
+
+/********************* events ************/
+
+static int Before(const struct event *a, const struct event *b)
+{
+  if (a->time != b->time)
+    return a->time < b->time;
+  if (a->src != b->src)
+    return a->src < b->src;
+  return a->order < b->order;
+}
+
+static void Push(struct heap *h, struct event e)
+{
+  int i;
+
+  if (h->size == h->cap) {
+    h->cap = h->cap ? 2 * h->cap : 1024;
+    h->e = realloc(h->e, h->cap * sizeof(struct event));
+    if (h->e == NULL) {
+      printf("pdes: out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i = h->size++; i > 0 && Before(&e, &h->e[(i - 1) / 2]); i = (i - 1) / 2)
+    h->e[i] = h->e[(i - 1) / 2];
+  h->e[i] = e;
+}
+
+static struct event Pop(struct heap *h)
+{
+  struct event top = h->e[0], last = h->e[--h->size];
+  int i = 0, child;
+
+  while ((child = 2 * i + 1) < h->size) {
+    if (child + 1 < h->size && Before(&h->e[child + 1], &h->e[child]))
+      child++;
+    if (!Before(&h->e[child], &last))
+      break;
+    h->e[i] = h->e[child];
+    i = child;
+  }
+  h->e[i] = last;
+  return top;
+}
+
+static int Owner(int lp)
+{
+  return (int)((long)lp * nthreads / NROUTERS);
+}
+
+/* LP 'from' schedules an event at e.lp */
+static void Schedule(int from, struct event e)
+{
+  int me = Owner(from), to = Owner(e.lp);
+
+  e.src = from;
+  e.order = created[from]++;
+  if (to == me)
+    Push(&heaps[me], e);
+  else {
+    struct outbox *o = &outboxes[me][to];
+    if (o->size == o->cap) {
+      o->cap = o->cap ? 2 * o->cap : 256;
+      o->e = realloc(o->e, o->cap * sizeof(struct event));
+      if (o->e == NULL) {
+        printf("pdes: out of memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    o->e[o->size++] = e;
+  }
+}
+
+/********************* the model ************/
+
+static double Uniform(int lp)
+{
+  uint64_t x = rng[lp];
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  rng[lp] = x;
+  return ((x * 2685821657736338717ull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int First(int f) { return f / FLOWSPERROUTER; }
+static int Last(int f)  { return (First(f) + HOPS) % NROUTERS; }
+
+/* router lp puts a packet on its link to the next router, or the previous one for an ACK */
+static void Transmit(int lp, double now, int flow, int seqnum, int ack)
+{
+  struct event e;
+
+  if (Uniform(lp) < LOSS)
+    return;
+  e.time = (linklast[ack][lp] > now ? linklast[ack][lp] : now) + LOOKAHEAD + 9.0 * Uniform(lp);
+  linklast[ack][lp] = e.time;
+  e.lp = (lp + (ack ? NROUTERS - 1 : 1)) % NROUTERS;
+  e.type = PACKET;
+  e.flow = flow;
+  e.seqnum = seqnum;
+  e.ack = ack;
+  e.gen = 0;
+  Schedule(lp, e);
+}
+
+static void StartTimer(int lp, double now, int f)
+{
+  struct event e;
+
+  e.time = now + RTT;
+  e.lp = lp;
+  e.type = TIMEOUT;
+  e.flow = f;
+  e.seqnum = e.ack = 0;
+  e.gen = ++timergen[f];
+  timerset[f] = 1;
+  Schedule(lp, e);
+}
+
+static void ScheduleMessage(int lp, double now, int f)
+{
+  struct event e;
+
+  e.time = now - LAMBDA * log(1.0 - Uniform(lp));
+  e.lp = lp;
+  e.type = MESSAGE;
+  e.flow = f;
+  e.seqnum = e.ack = e.gen = 0;
+  Schedule(lp, e);
+}
+
+static void Handle(const struct event *e)
+{
+  int lp = e->lp, f = e->flow, i;
+
+  processed[lp]++;
+  if (e->type == MESSAGE) {
+    if (--msgsleft[f] > 0)
+      ScheduleMessage(lp, e->time, f);
+    if (nextseq[f] - base[f] < WINDOWSIZE) {
+      Transmit(lp, e->time, f, nextseq[f]++, 0);
+      if (!timerset[f])
+        StartTimer(lp, e->time, f);
+    } else
+      dropped[f]++;
+  } else if (e->type == TIMEOUT) {
+    if (e->gen != timergen[f])
+      return;
+    for (i = 0; i < nextseq[f] - base[f]; i++)
+      if (!(acked[f] >> i & 1)) {
+        Transmit(lp, e->time, f, base[f] + i, 0);
+        resent[f]++;
+      }
+    StartTimer(lp, e->time, f);
+  } else if (!e->ack && lp == Last(f)) {
+    /* data at the receiver, which ACKs it whether new or not */
+    int offset = e->seqnum - expected[f];
+    if (offset >= 0 && offset < WINDOWSIZE) {
+      received[f] |= 1u << offset;
+      while (received[f] & 1) {
+        received[f] >>= 1;
+        expected[f]++;
+        delivered[f]++;
+        finish[f] = e->time;
+      }
+    }
+    Transmit(lp, e->time, f, e->seqnum, 1);
+  } else if (e->ack && lp == First(f)) {
+    /* an ACK back at the sender */
+    int offset = e->seqnum - base[f];
+    if (offset >= 0 && offset < nextseq[f] - base[f] && !(acked[f] >> offset & 1)) {
+      acked[f] |= 1u << offset;
+      while ((acked[f] & 1) && base[f] != nextseq[f]) {
+        acked[f] >>= 1;
+        base[f]++;
+      }
+      if (base[f] == nextseq[f]) {
+        timergen[f]++;
+        timerset[f] = 0;
+      } else
+        StartTimer(lp, e->time, f);
+    }
+  } else
+    Transmit(lp, e->time, f, e->seqnum, e->ack);   /* pass it on */
+}
+
+/********************* the engines ************/
+
+static void Reset(int threads)
+{
+  int lp, f, i, j;
+
+  nthreads = threads;
+  for (i = 0; i < MAXTHREADS; i++) {
+    heaps[i].size = 0;
+    for (j = 0; j < MAXTHREADS; j++)
+      outboxes[i][j].size = 0;
+  }
+  for (lp = 0; lp < NROUTERS; lp++) {
+    rng[lp] = 88172645463325252ull + 2654435761ull * lp;
+    created[lp] = 0;
+    linklast[0][lp] = linklast[1][lp] = 0.0;
+    processed[lp] = 0;
+  }
+  for (f = 0; f < NFLOWS; f++) {
+    msgsleft[f] = MESSAGES;
+    base[f] = nextseq[f] = expected[f] = 0;
+    acked[f] = received[f] = 0;
+    timergen[f] = timerset[f] = 0;
+    resent[f] = dropped[f] = delivered[f] = 0;
+    finish[f] = 0.0;
+  }
+  for (f = 0; f < NFLOWS; f++)
+    ScheduleMessage(First(f), 0.0, f);
+}
+
+/* the sequential engine: one queue, one event at a time */
+static void Sequential(void)
+{
+  Reset(1);
+  while (heaps[0].size > 0) {
+    struct event e = Pop(&heaps[0]);
+    Handle(&e);
+  }
+}
+
+/* one thread of the parallel engine */
+static void *Worker(void *arg)
+{
+  int me = (int)(intptr_t)arg, i, j;
+  struct heap *h = &heaps[me];
+
+  for (;;) {
+    double window = INFINITY;
+
+    nexttime[me] = h->size > 0 ? h->e[0].time : INFINITY;
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < nthreads; i++)
+      if (nexttime[i] < window)
+        window = nexttime[i];
+    if (window == INFINITY)
+      break;
+
+    /* nothing from another thread can arrive before window + LOOKAHEAD */
+    window += LOOKAHEAD;
+    while (h->size > 0 && h->e[0].time < window) {
+      struct event e = Pop(h);
+      Handle(&e);
+    }
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < nthreads; i++) {
+      struct outbox *o = &outboxes[i][me];
+      for (j = 0; j < o->size; j++)
+        Push(h, o->e[j]);
+      o->size = 0;
+    }
+  }
+  return NULL;
+}
+
+static void Parallel(int threads)
+{
+  pthread_t tid[MAXTHREADS];
+  int i;
+
+  Reset(threads);
+  pthread_barrier_init(&barrier, NULL, threads);
+  for (i = 0; i < threads; i++)
+    pthread_create(&tid[i], NULL, Worker, (void *)(intptr_t)i);
+  for (i = 0; i < threads; i++)
+    pthread_join(tid[i], NULL);
+  pthread_barrier_destroy(&barrier);
+}
+
+/********************* the driver ************/
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* print the results of the last run and return a digest of them */
+static uint64_t Report(const char *name, double elapsed)
+{
+  uint64_t digest = 1469598103934665603ull;
+  long events = 0, sumdelivered = 0, sumresent = 0;
+  double last = 0.0;
+  int lp, f;
+
+  for (lp = 0; lp < NROUTERS; lp++)
+    events += processed[lp];
+  for (f = 0; f < NFLOWS; f++) {
+    sumdelivered += delivered[f];
+    sumresent += resent[f];
+    if (finish[f] > last)
+      last = finish[f];
+    digest = (digest ^ (uint64_t)delivered[f]) * 1099511628211ull;
+    digest = (digest ^ (uint64_t)resent[f]) * 1099511628211ull;
+    digest = (digest ^ (uint64_t)(finish[f] * 1024.0)) * 1099511628211ull;
+  }
+  printf("%-14s %8.3f s  %11.0f events/s  (%ld events, %ld delivered, %ld resent, "
+         "last delivery %f)\n", name, elapsed, events / elapsed, events, sumdelivered,
+         sumresent, last);
+  return digest;
+}
+
+int main(int argc, char *argv[])
+{
+  static const int defaults[] = { 1, 2, 4, 8 };
+  uint64_t reference;
+  double start, sequential;
+  char name[32];
+  int i, same = 1, n = argc > 1 ? argc - 1 : 4;
+
+  printf("%d routers, %d flows of %d messages over %d hops\n", NROUTERS, NFLOWS, MESSAGES, HOPS);
+  start = Seconds();
+  Sequential();
+  sequential = Seconds() - start;
+  reference = Report("sequential", sequential);
+
+  for (i = 0; i < n; i++) {
+    int threads = argc > 1 ? atoi(argv[i + 1]) : defaults[i];
+    double elapsed;
+    if (threads < 1 || threads > MAXTHREADS) {
+      printf("pdes: between 1 and %d threads\n", MAXTHREADS);
+      return EXIT_FAILURE;
+    }
+    start = Seconds();
+    Parallel(threads);
+    elapsed = Seconds() - start;
+    snprintf(name, sizeof(name), "%d thread%s", threads, threads > 1 ? "s" : "");
+    if (Report(name, elapsed) != reference) {
+      printf("  results differ from the sequential engine\n");
+      same = 0;
+    } else
+      printf("  same results, speedup %.2f\n", sequential / elapsed);
+  }
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,83 @@
+/* Block random number generator for the emulator's jimsrand().
+
+   RNGLANES independent xoshiro128+ generators are advanced side by side,
+   each lane's state in its own array slot, so the fill loop has no
+   dependence between lanes and the compiler turns it into vector
+   instructions (build with -O3, and -mavx2 for eight lanes per
+   instruction).  A stream hands out the doubles of one block, lane
+   after lane, and refills the block when it runs out.
+
+   Everything is static so the header can be included by the emulator
+   and by rngbench.c without another file to link. */
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+#define RNGLANES 8        /* generators advanced together */
+#define RNGBLOCK 1024     /* doubles filled at a time, a multiple of RNGLANES */
+
+struct rngstream {
+  uint32_t s0[RNGLANES], s1[RNGLANES], s2[RNGLANES], s3[RNGLANES];
+  double block[RNGBLOCK];
+  int next;               /* next unused entry of block[] */
+};
+
+/* a 64-bit constant from two 32-bit halves, C89 has no long long literals */
+#define RNG64(hi, lo) ((uint64_t)(hi) << 32 | (uint64_t)(lo))
+
+/* SplitMix64, to spread one seed over the lanes' states */
+static uint64_t RngSplitMix(uint64_t *x)
+{
+  uint64_t z = (*x += RNG64(0x9E3779B9, 0x7F4A7C15));
+
+  z = (z ^ (z >> 30)) * RNG64(0xBF58476D, 0x1CE4E5B9);
+  z = (z ^ (z >> 27)) * RNG64(0x94D049BB, 0x133111EB);
+  return z ^ (z >> 31);
+}
+
+static void RngSeed(struct rngstream *r, uint64_t seed)
+{
+  int i;
+
+  for (i = 0; i < RNGLANES; i++) {
+    uint64_t a = RngSplitMix(&seed), b = RngSplitMix(&seed);
+    r->s0[i] = (uint32_t)a;
+    r->s1[i] = (uint32_t)(a >> 32);
+    r->s2[i] = (uint32_t)b;
+    r->s3[i] = (uint32_t)(b >> 32) | 1;    /* never all zero */
+  }
+  r->next = RNGBLOCK;
+}
+
+/* fill the whole block, RNGLANES numbers per step */
+static void RngFill(struct rngstream *r)
+{
+  int i, j;
+
+  for (i = 0; i < RNGBLOCK; i += RNGLANES)
+    for (j = 0; j < RNGLANES; j++) {
+      uint32_t out = r->s0[j] + r->s3[j];
+      uint32_t t = r->s1[j] << 9;
+
+      r->s2[j] ^= r->s0[j];
+      r->s3[j] ^= r->s1[j];
+      r->s1[j] ^= r->s2[j];
+      r->s0[j] ^= r->s3[j];
+      r->s2[j] ^= t;
+      r->s3[j] = (r->s3[j] << 11) | (r->s3[j] >> 21);
+      r->block[i + j] = out * (1.0 / 4294967296.0);   /* uniform in [0,1) */
+    }
+  r->next = 0;
+}
+
+/* the next uniform double of the stream */
+static double RngNext(struct rngstream *r)
+{
+  if (r->next == RNGBLOCK)
+    RngFill(r);
+  return r->block[r->next++];
+}
+
+#endif
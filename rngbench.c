@@ -0,0 +1,116 @@
+/**********************************************************************
+   Benchmark of the block random number generator in rng.h
+
+   Measures the draws per second of rand()/RAND_MAX, as jimsrand()
+   makes them, against the block generator, then builds the emulator
+   with sr.c both ways (-DFASTRAND=0 and 1) and reports the events per
+   second of a whole simulation.
+
+   Build and run from the directory holding the emulator sources:
+     gcc -O3 -mavx2 rngbench.c -o rngbench
+     ./rngbench [messages] [loss] [corruption] [lambda]
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rng.h"
+
+#define DRAWS 100000000L  /* draws timed for each generator */
+#define CFLAGS "-O3 -mavx2"
+
+static double Seconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void Draws(void)
+{
+  static struct rngstream stream;
+  double sum = 0.0, start, libc, block;
+  long i;
+
+  srand(9999);
+  start = Seconds();
+  for (i = 0; i < DRAWS; i++)
+    sum += rand() / (double)RAND_MAX;
+  libc = Seconds() - start;
+
+  RngSeed(&stream, 9999);
+  start = Seconds();
+  for (i = 0; i < DRAWS; i++)
+    sum += RngNext(&stream);
+  block = Seconds() - start;
+
+  printf("rand()/RAND_MAX  %8.1f M draws/s\n", DRAWS / libc / 1e6);
+  printf("block generator  %8.1f M draws/s  (%.2fx)\n", DRAWS / block / 1e6, libc / block);
+  printf("(mean of all draws %f)\n", sum / (2 * DRAWS));
+}
+
+/* build the emulator with the given FASTRAND, run it and return its events per second */
+static double Simulate(int fastrand, const char *input)
+{
+  char binary[64], command[256], line[256];
+  long events = 0;
+  double start, elapsed;
+  FILE *fp;
+
+  snprintf(binary, sizeof(binary), "/tmp/rngbench-%d-%d", (int)getpid(), fastrand);
+  snprintf(command, sizeof(command), "gcc %s -DFASTRAND=%d emulator.c sr.c -o %s -lm",
+           CFLAGS, fastrand, binary);
+  if (system(command) != 0) {
+    printf("unable to build the emulator\n");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(command, sizeof(command), "%s < %s", binary, input);
+  start = Seconds();
+  fp = popen(command, "r");
+  if (fp == NULL)
+    exit(EXIT_FAILURE);
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char *p = strstr(line, "number of events simulated:");
+    if (p != NULL)
+      sscanf(p + strlen("number of events simulated:"), "%ld", &events);
+  }
+  pclose(fp);
+  elapsed = Seconds() - start;
+  remove(binary);
+  printf("emulator, FASTRAND %d  %10ld events in %.3f s  %12.0f events/s\n",
+         fastrand, events, elapsed, events / elapsed);
+  return events / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  int messages = argc > 1 ? atoi(argv[1]) : 20000;
+  float loss = argc > 2 ? atof(argv[2]) : 0.2;
+  float corrupt = argc > 3 ? atof(argv[3]) : 0.2;
+  float lambda = argc > 4 ? atof(argv[4]) : 50.0;
+  char input[64];
+  double before, after;
+  FILE *fp;
+
+  Draws();
+
+  snprintf(input, sizeof(input), "/tmp/rngbench-%d.in", (int)getpid());
+  fp = fopen(input, "w");
+  if (fp == NULL) {
+    printf("unable to write %s\n", input);
+    return EXIT_FAILURE;
+  }
+  fprintf(fp, "%d\n%f\n%f\n", messages, loss, corrupt);
+  if (loss != 0.0 || corrupt != 0.0)
+    fprintf(fp, "2\n");
+  fprintf(fp, "%f\n0\n", lambda);
+  fclose(fp);
+
+  before = Simulate(0, input);
+  after = Simulate(1, input);
+  printf("end to end: %.2fx the events per second\n", after / before);
+  remove(input);
+  return EXIT_SUCCESS;
+}
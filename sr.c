@@ -1,8 +1,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
 #include "emulator.h"
+#if defined(PROTOCOL_PREFIX) || defined(GENERIC_WINDOW)
+#include "fastpath.h"
+#endif
 #include "sr.h"
+#include "aead.h"
+#include "lz.h"
 
 /* ******************************************************************
    Go Back N protocol.  Adapted from J.F.Kurose
@@ -22,20 +29,71 @@
    - added GBN implementation
 **********************************************************************/
 
+/* RTT and WINDOWSIZE may be given on the compiler command line (-D), the tuner does,
+   and fastpath.c builds one copy per common window plus a generic one (fastpath.h) */
+#ifndef RTT
 #define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#endif
+#ifndef WINDOWSIZE
 #define WINDOWSIZE 6    /* the maximum number of buffered unacked packet
                           MUST BE SET TO 6 when submitting assignment */
-#define SEQSPACE 12      /* Double the window size for SR to avoid ambiguity */
+#endif
+#define SEQSPACE (2 * WINDOWSIZE) /* Double the window size for SR to avoid ambiguity */
+#ifdef GENERIC_WINDOW
+#define SEQSLOTS (2 * MAXWINDOW)
+int protocol_window = 6;
+#else
+#define SEQSLOTS SEQSPACE /* entries of the arrays indexed by sequence number */
+#endif
 #define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+#define ADAPTIVE_RTO 0  /* 1 = time out after the RTO estimated from timestamp RTT samples, 0 = fixed RTT */
+#define MINRTO 2.0      /* lower bound on the estimated RTO */
+#define MAXRTO 64.0     /* upper bound on the estimated RTO */
+#define TLP 0           /* 1 = send a tail loss probe when the window goes quiet before the RTO */
+#define CONGESTION 0    /* 0 = fixed window, 1 = AIMD window halved on timeouts,
+                           2 = AIMD window also halved on ECN echoes, before any loss */
+#define RATEBASED 0     /* 1 = BBR-style sending: pace at the estimated bottleneck bandwidth
+                           and cap the packets in flight at a multiple of the estimated BDP */
+#define SENDQUEUE 64    /* messages that can wait for their paced send time */
+#define BWFILTER 10     /* rounds over which the bottleneck bandwidth max filter runs */
+#define MINRTTFILTER 500.0 /* time over which the min RTT filter runs */
+#define STARTUPGAIN 2.885  /* 2/ln(2): doubles the delivery rate every round in startup */
+#define MINCWND 4       /* smallest inflight cap in rate based mode */
+#define SCHEDULER 0     /* packet scheduler when NPATHS > 1: 0 = lowest RTT path with room,
+                           1 = round-robin, 2 = a redundant copy on every path */
+#define PATHWINDOW ((WINDOWSIZE + NPATHS - 1) / NPATHS) /* packets in flight per path for the
+                                                          lowest RTT scheduler */
+#define COMBINE 0       /* 1 = B keeps corrupted copies and rebuilds a packet from the intact header
+                           of one copy and the intact payload of another, 2 = B also repairs a
+                           corrupted seqnum or acknum from the parity field */
+#define COMBINEPOOL 8   /* corrupted copies B keeps for combining */
+#define NAKINTERVAL RTT /* multicast (NRECEIVERS > 1): a receiver NAKs a missing packet at most
+                           once in this time */
+#define NAKHOLDOFF (RTT / 2) /* multicast: NAKs for a packet within this time of resending it
+                                are answered by that resend */
+#define ALLRECEIVERS ((1 << NRECEIVERS) - 1)
+#define AEAD 0          /* 1 = encrypt payloads with AES-GCM (aead.h), the header as associated
+                           data, and drop packets whose tag fails; -maes -mpclmul -mssse3 for
+                           the hardware path */
+#define COMPRESS 0      /* 1 = bulk transfer: a message that finds the window full waits in the send
+                           queue instead of being dropped, and the queued messages of a stream are
+                           compressed (lz.h) together into as few packets as they fit */
+#define COALESCE 8      /* most messages compressed into one packet */
 
 /* generic procedure to compute the checksum of a packet.  Used by both sender and receiver
    the simulator will overwrite part of your packet with 'z's.  It will not overwrite your
    original checksum.  This procedure must generate a different checksum to the original if
    the packet is corrupted.
 */
+static int HeaderChecksum(struct pkt packet)
+{
+  return packet.seqnum + packet.acknum + (packet.flags & ~PKT_ECNMASK)
+         + packet.stream + packet.streamseq;
+}
+
 int ComputeChecksum(struct pkt packet)
 {
-  int checksum = packet.seqnum + packet.acknum;
+  int checksum = HeaderChecksum(packet);
   int i;
   for ( i=0; i<20; i++ )
     checksum += (int)(packet.payload[i]);
@@ -47,65 +105,748 @@ bool IsCorrupted(struct pkt packet)
   return packet.checksum != ComputeChecksum(packet);
 }
 
+/* fill in the checksums of a packet about to be sent */
+static void SetChecksums(struct pkt *packet)
+{
+  packet->checksum = ComputeChecksum(*packet);
+  packet->hdrchecksum = HeaderChecksum(*packet);
+  packet->parity = packet->seqnum - packet->acknum;
+}
+
+/* AEAD: the key A and B share.  A deployment would agree a fresh key per connection, the
+   nonce counters restart with every run */
+static const uint8_t aead_secret[16] = "sr shared secret";
+static struct aeadkey aead_key;
+static int sealed[2];             /* AEAD: packets sealed by A and by B, the nonce counters */
+
+/* AEAD: associated data, the header fields the checksum covers and the nonce counter */
+static void AeadHeader(const struct pkt *packet, uint8_t aad[6 * sizeof(int)])
+{
+  int fields[6];
+
+  fields[0] = packet->seqnum;
+  fields[1] = packet->acknum;
+  fields[2] = packet->flags & ~PKT_ECNMASK;   /* the channel may mark CE */
+  fields[3] = packet->stream;
+  fields[4] = packet->streamseq;
+  fields[5] = packet->nonce;
+  memcpy(aad, fields, sizeof(fields));
+}
+
+static void AeadNonce(int entity, int counter, uint8_t nonce[AEADNONCE])
+{
+  memset(nonce, 0, AEADNONCE);
+  nonce[0] = entity == A ? 'A' : 'B';
+  memcpy(nonce + 4, &counter, sizeof(counter));
+}
+
+/* AEAD: encrypt the payload of a packet entity sends and tag it, then checksum the
+   ciphertext, so the checksum still screens out channel corruption before the tag is
+   checked.  A retransmission resends the sealed copy, so a burst of them costs no crypto */
+static void Seal(struct pkt *packet, int entity)
+{
+  uint8_t aad[6 * sizeof(int)], nonce[AEADNONCE];
+
+  packet->nonce = sealed[entity]++;
+  AeadHeader(packet, aad);
+  AeadNonce(entity, packet->nonce, nonce);
+  AeadSeal(&aead_key, nonce, aad, sizeof(aad), (uint8_t *)packet->payload,
+           (uint8_t *)packet->payload, 20, packet->tag);
+  SetChecksums(packet);
+}
+
+/* AEAD: check the tag of a packet from entity and decrypt its payload, false if it fails */
+static bool Unseal(struct pkt *packet, int entity)
+{
+  uint8_t aad[6 * sizeof(int)], nonce[AEADNONCE];
+
+  AeadHeader(packet, aad);
+  AeadNonce(entity, packet->nonce, nonce);
+  if (!AeadOpen(&aead_key, nonce, aad, sizeof(aad), (uint8_t *)packet->payload,
+                (uint8_t *)packet->payload, 20, packet->tag)) {
+    if (TRACE > 0)
+      printf("----%c: packet %d fails authentication, dropped\n", entity == A ? 'B' : 'A',
+             packet->seqnum);
+    return false;
+  }
+  SetChecksums(packet);   /* of the plaintext, as the rest of the receiver expects */
+  return true;
+}
+
 
 /********* Sender (A) variables and functions ************/
 
-static struct pkt buffer[SEQSPACE];  /* array for storing packets waiting for ACK */
-static bool acked[SEQSPACE]; /*Individual ack tracking */
+static struct pkt buffer[SEQSLOTS];  /* array for storing packets waiting for ACK */
+static bool acked[SEQSLOTS]; /*Individual ack tracking */
 static int base;                /* the number of packets currently awaiting an ACK */
 static int nextseqnum;               /* the next sequence number to be used by the sender */
 static bool timer_running = false; /* New flag for timer status*/
+static float srtt;                 /* smoothed RTT from timestamp samples */
+static float rttvar;               /* RTT variation from timestamp samples */
+static float rto;                  /* timeout used when (re)starting the timer */
+static float rto_deadline;         /* time the retransmission timeout for the window expires */
+static bool probe_pending;         /* a tail loss probe may still be sent before rto_deadline */
+static float probe_deadline;       /* time the tail loss probe is sent if the window stays quiet */
+static float deadline[SEQSLOTS];   /* time after which buffer[i] is abandoned, 0.0 = never */
+static bool abandoned[SEQSLOTS];   /* buffer[i] expired and is no longer retransmitted */
+static int forwardseq;             /* seqnum B is being asked to skip to, or NOTINUSE */
+static int skippedby;              /* multicast: receivers that confirmed the forward-skip, one bit each */
+static int streamnext[NSTREAMS];   /* position of the next message sent on each stream */
+static float cwnd;                 /* congestion window, never above WINDOWSIZE */
+static float recovery_end;         /* no further window reduction before this time */
+static float pathrtt[NPATHS];      /* smoothed RTT of each path, 0.0 until sampled */
+static int nextpath;               /* next path for the round-robin scheduler */
+static int ackedby[SEQSLOTS];      /* multicast: receivers that ACKed buffer[i], one bit each */
+static struct msg *zc_msg[SEQSLOTS]; /* zero-copy: the application's message buffer[i] carries,
+                                       NULL when the payload was copied into buffer[i] */
+static sendcomplete zc_done[SEQSLOTS]; /* zero-copy: how to hand zc_msg[i] back */
+static float nak_holdoff[SEQSLOTS]; /* multicast: NAKs for buffer[i] before this time are
+                                      covered by the last resend */
 
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
+/* rate based (BBR-style) sender state */
+#define STARTUP  0                  /* grow the rate until the bandwidth estimate stops growing */
+#define DRAIN    1                  /* drain the queue built up during startup */
+#define PROBE_BW 2                  /* cycle the pacing gain around the bandwidth estimate */
+static struct msg sendqueue[SENDQUEUE]; /* messages waiting for their paced send time */
+static float queuetime[SENDQUEUE];  /* time each queued message reached A_output() */
+static int queuefirst, queuecount;
+static float pace_deadline;         /* earliest time of the next paced send */
+static int delivered_count;         /* packets ACKed so far */
+static float delivered_time;        /* time of the last ACK that advanced delivered_count */
+static int sent_delivered[SEQSLOTS];      /* delivered_count when buffer[i] was sent */
+static float sent_delivered_time[SEQSLOTS]; /* delivered_time when buffer[i] was sent */
+static float bwsamples[BWFILTER];   /* highest delivery rate seen in each recent round */
+static float btlbw;                 /* bottleneck bandwidth estimate, packets per time unit */
+static float minrtt;                /* min RTT estimate */
+static float minrtt_stamp;          /* time minrtt was taken */
+static int round_count;             /* round trips counted in delivered packets */
+static int round_end;               /* delivered_count that ends the current round */
+static int bbr_state;
+static float pacing_gain, cwnd_gain;
+static float full_bw;               /* bandwidth estimate when startup last saw growth */
+static int full_bw_rounds;          /* rounds in startup without 25% growth */
+static int cycle_index;             /* position in the PROBE_BW gain cycle */
+static float cycle_stamp;           /* time the current gain cycle phase started */
+static const float cycle_gains[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+/* take an RTT sample from the timestamp echoed in an ACK and update the RTO estimate.
+   Each transmission carries its own timestamp, so samples stay unambiguous after a resend. */
+static void SampleRTT(struct pkt packet)
 {
-  if ((nextseqnum + SEQSPACE - base) % SEQSPACE < WINDOWSIZE) {
-    struct pkt sendpkt;
-    int i;
-    sendpkt.seqnum = nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for (i = 0; i < 20; i++) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt);
+  float sample;
 
-    buffer[nextseqnum] = sendpkt;
-    acked[nextseqnum] = false;
+  if (packet.timestamp < 0.0)
+    return;
+  sample = currenttime() - packet.timestamp;
+  record_rtt(sample);
 
-    if (TRACE > 0) {
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-      printf("Sending packet %d to layer 3\n", nextseqnum);
+  if (srtt == 0.0) {
+    srtt = sample;
+    rttvar = sample / 2;
+  } else {
+    rttvar = 0.75 * rttvar + 0.25 * (srtt > sample ? srtt - sample : sample - srtt);
+    srtt = 0.875 * srtt + 0.125 * sample;
+  }
+  if (ADAPTIVE_RTO || RATEBASED) {   /* a fixed RTO would fire under the queueing the model measures */
+    rto = srtt + 4 * rttvar;
+    if (rto < MINRTO) rto = MINRTO;
+    if (rto > MAXRTO) rto = MAXRTO;
+  }
+
+  /* the ACK comes back on the path the packet took, so this is also a sample of that path */
+  if (packet.path >= 0 && packet.path < NPATHS)
+    pathrtt[packet.path] = pathrtt[packet.path] == 0.0 ? sample
+                           : 0.875 * pathrtt[packet.path] + 0.125 * sample;
+
+  /* min RTT filter for the rate based sender, refreshed when it gets stale */
+  if (minrtt == 0.0 || sample <= minrtt || currenttime() - minrtt_stamp > MINRTTFILTER) {
+    minrtt = sample;
+    minrtt_stamp = currenttime();
+  }
+}
+
+/* choose the path for buffer[seqnum], or for a packet outside the buffer if seqnum is NOTINUSE */
+static int PickPath(int seqnum)
+{
+  int inflight[NPATHS];
+  int i, path, best = NOTINUSE;
+
+  if (NPATHS == 1)
+    return 0;
+  if (SCHEDULER == 1) {
+    path = nextpath;
+    nextpath = (nextpath + 1) % NPATHS;
+    return path;
+  }
+
+  /* lowest RTT path that still has room.  Unsampled paths count as fastest, so
+     every path gets measured. */
+  for (path = 0; path < NPATHS; path++)
+    inflight[path] = 0;
+  for (i = 0; i < (nextseqnum + SEQSPACE - base) % SEQSPACE; i++) {
+    int idx = (base + i) % SEQSPACE;
+    if (idx != seqnum && !acked[idx] && !abandoned[idx])
+      inflight[buffer[idx].path]++;
+  }
+  for (path = 0; path < NPATHS; path++) {
+    if (inflight[path] >= PATHWINDOW)
+      continue;
+    if (best == NOTINUSE || pathrtt[path] < pathrtt[best])
+      best = path;
+  }
+  return best == NOTINUSE ? 0 : best;
+}
+
+/* hand buffer[seqnum] to layer 3.  A zero-copy packet's payload is passed by pointer
+   from the application's message, which the channel copies once into its own packet */
+static void Transmit(int seqnum)
+{
+  if (zc_msg[seqnum] == NULL)
+    tolayer3(A, buffer[seqnum]);
+  else
+    tolayer3_zc(A, &buffer[seqnum], zc_msg[seqnum]->data);
+}
+
+/* zero-copy: A is done with buffer[seqnum], give the application its message back */
+static void Release(int seqnum)
+{
+  struct msg *message = zc_msg[seqnum];
+
+  if (message != NULL) {
+    /* the fixed-RTO sender takes ACKs from outside the window, which can slide base past
+       nextseqnum and resend this slot later, so it keeps the payload after all */
+    if (!(TLP || ADAPTIVE_RTO))
+      memcpy(buffer[seqnum].payload, message->data, sizeof(buffer[seqnum].payload));
+    zc_msg[seqnum] = NULL;
+    zc_done[seqnum](message);
+  }
+}
+
+/* (re)send buffer[seqnum] on the path the scheduler picks */
+static void SendBuffered(int seqnum)
+{
+  int path;
+
+  buffer[seqnum].timestamp = currenttime();
+  if (SCHEDULER == 2 && NPATHS > 1) {
+    for (path = 0; path < NPATHS; path++) {
+      buffer[seqnum].path = path;
+      Transmit(seqnum);
+    }
+    return;
+  }
+  buffer[seqnum].path = PickPath(seqnum);
+  Transmit(seqnum);
+}
+
+/* number of packets sent but not yet ACKed or abandoned */
+static int InFlight(void)
+{
+  int i, count = 0;
+
+  for (i = 0; i < (nextseqnum + SEQSPACE - base) % SEQSPACE; i++) {
+    int idx = (base + i) % SEQSPACE;
+    if (!acked[idx] && !abandoned[idx])
+      count++;
+  }
+  return count;
+}
+
+/* rate based inflight cap: cwnd_gain times the estimated bandwidth-delay product */
+static int RateWindow(void)
+{
+  int limit = (int)(cwnd_gain * btlbw * minrtt);
+
+  if (limit < MINCWND)
+    limit = MINCWND;
+  return limit;
+}
+
+/* update the bandwidth and RTT model when the ACK for buffer[seqnum] arrives */
+static void UpdateModel(int seqnum)
+{
+  float interval, rate;
+  bool round_start = false;
+  int i;
+
+  delivered_count++;
+  delivered_time = currenttime();
+
+  /* a round ends once a packet sent after the previous round ended is ACKed */
+  if (sent_delivered[seqnum] >= round_end) {
+    round_count++;
+    round_end = delivered_count;
+    round_start = true;
+    bwsamples[round_count % BWFILTER] = 0.0;
+  }
+
+  /* delivery rate: packets ACKed since this one was sent, over the time that took */
+  interval = delivered_time - sent_delivered_time[seqnum];
+  if (interval > 0.0) {
+    rate = (delivered_count - sent_delivered[seqnum]) / interval;
+    if (rate > bwsamples[round_count % BWFILTER])
+      bwsamples[round_count % BWFILTER] = rate;
+  }
+  btlbw = 0.0;
+  for (i = 0; i < BWFILTER; i++)
+    if (bwsamples[i] > btlbw)
+      btlbw = bwsamples[i];
+
+  switch (bbr_state) {
+  case STARTUP:
+    if (!round_start)
+      break;
+    if (btlbw >= full_bw * 1.25) {
+      full_bw = btlbw;
+      full_bw_rounds = 0;
+    } else if (++full_bw_rounds >= 3) {
+      if (TRACE > 0)
+        printf("----A: bandwidth estimate %f stopped growing, draining the queue\n", btlbw);
+      bbr_state = DRAIN;
+      pacing_gain = 1 / STARTUPGAIN;
+    }
+    break;
+  case DRAIN:
+    if (InFlight() <= btlbw * minrtt) {
+      bbr_state = PROBE_BW;
+      pacing_gain = cycle_gains[cycle_index];
+      cwnd_gain = 2.0;
+      cycle_stamp = currenttime();
+    }
+    break;
+  case PROBE_BW:
+    if (currenttime() - cycle_stamp > minrtt) {
+      cycle_index = (cycle_index + 1) % 8;
+      pacing_gain = cycle_gains[cycle_index];
+      cycle_stamp = currenttime();
+    }
+    break;
+  }
+}
+
+/* halve the congestion window, at most once per round trip */
+static void ReduceWindow(void)
+{
+  if (currenttime() < recovery_end)
+    return;
+  cwnd = cwnd / 2;
+  if (cwnd < 1.0)
+    cwnd = 1.0;
+  recovery_end = currenttime() + (srtt > 0.0 ? srtt : rto);
+  window_reductions++;
+  if (TRACE > 0)
+    printf("----A: reducing congestion window to %f\n", cwnd);
+}
+
+/* probe timeout for TLP: two smoothed RTTs, or half the RTO before the first sample */
+static float ProbeTimeout(void)
+{
+  if (srtt > 0.0)
+    return 2 * srtt;
+  return rto / 2;
+}
+
+/* A has a single timer.  With TLP or pacing it is set for the earliest of the
+   retransmission timeout, the tail loss probe and the next paced send. */
+static void ArmTimer(void)
+{
+  float expiry = -1.0;
+
+  if (base != nextseqnum) {
+    expiry = rto_deadline;
+    if (probe_pending && probe_deadline < expiry)
+      expiry = probe_deadline;
+  }
+  /* only wake for a paced send; when the inflight cap is what holds the queue back an ACK will */
+  if (RATEBASED && queuecount > 0 && pace_deadline > currenttime()
+      && (expiry < 0.0 || pace_deadline < expiry))
+    expiry = pace_deadline;
+
+  if (timer_running)
+    stoptimer(A);
+  timer_running = false;
+  if (expiry >= 0.0) {
+    starttimer(A, expiry > currenttime() ? expiry - currenttime() : 0.0);
+    timer_running = true;
+  }
+}
+
+/* (re)start A's timer for a fresh retransmission timeout.  With TLP the timer
+   first fires after the shorter probe timeout. */
+static void RestartTimer(void)
+{
+  rto_deadline = currenttime() + rto;
+  probe_pending = TLP;
+  probe_deadline = currenttime() + ProbeTimeout();
+  if (TLP || RATEBASED) {
+    ArmTimer();
+    return;
+  }
+  if (timer_running)
+    stoptimer(A);
+  starttimer(A, rto);
+  timer_running = true;
+}
+
+/* new data went out: push the tail loss probe back, as the window is not quiet yet */
+static void DelayProbe(void)
+{
+  probe_deadline = currenttime() + ProbeTimeout();
+  ArmTimer();
+}
+
+/* retransmit the highest outstanding packet to provoke an ACK for the tail of the window */
+static void SendProbe(void)
+{
+  int i;
+
+  for (i = (nextseqnum + SEQSPACE - base) % SEQSPACE; i > 0; i--) {
+    int idx = (base + i - 1) % SEQSPACE;
+    if (!acked[idx] && !abandoned[idx]) {
+      if (TRACE > 0)
+        printf("----A: window is quiet, sending tail loss probe %d\n", idx);
+      SendBuffered(idx);
+      packets_resent++;
+      tlp_probes++;
+      return;
     }
+  }
+}
+
+/* give up on expired packets and, once the packet at base is abandoned, ask B to skip
+   past the abandoned run.  The window only slides after B ACKs the forward-skip, so B
+   never sees a sequence number beyond its own window. */
+static void AbandonExpired(void)
+{
+  struct pkt fwdpkt;
+  int previous = forwardseq;
+  int i;
+
+  for (i = 0; i < (nextseqnum + SEQSPACE - base) % SEQSPACE; i++) {
+    int idx = (base + i) % SEQSPACE;
+    if (!acked[idx] && !abandoned[idx] && deadline[idx] > 0.0 && currenttime() >= deadline[idx]) {
+      if (TRACE > 0)
+        printf("----A: lifetime of packet %d expired, abandoning it\n", idx);
+      abandoned[idx] = true;
+      messages_abandoned++;
+      Release(idx);
+    }
+  }
+  if (!abandoned[base])
+    return;
+
+  forwardseq = base;
+  while (forwardseq != nextseqnum && (acked[forwardseq] || abandoned[forwardseq]))
+    forwardseq = (forwardseq + 1) % SEQSPACE;
+  if (forwardseq != previous)
+    skippedby = 0;       /* a new skip, every receiver has to confirm it */
+
+  if (TRACE > 0)
+    printf("----A: sending forward-skip to %d\n", forwardseq);
+  fwdpkt.seqnum = forwardseq;
+  fwdpkt.acknum = base;
+  fwdpkt.flags = PKT_FORWARD;
+  fwdpkt.stream = 0;
+  fwdpkt.streamseq = 0;
+  for (i = 0; i < 20; i++)
+    fwdpkt.payload[i] = '0';
+  fwdpkt.nonce = 0;
+  memset(fwdpkt.tag, 0, sizeof(fwdpkt.tag));
+  SetChecksums(&fwdpkt);
+  if (AEAD)
+    Seal(&fwdpkt, A);
+  fwdpkt.timestamp = currenttime();
+  fwdpkt.msgtime = currenttime();
+  fwdpkt.path = PickPath(NOTINUSE);
+  fwdpkt.receiver = 0;
+  tolayer3(A, fwdpkt);
+}
+
+/* put a message that fits in the window into a packet and send it.  The packet is built
+   in place in the window.  With done set the payload stays in the application's message
+   (zero-copy) until Release() hands it back; otherwise it is copied into the window. */
+static void SendMessage(struct msg *message, float msgtime, int flags, sendcomplete done)
+{
+  struct pkt *sendpkt = &buffer[nextseqnum];
+  int i;
+
+  sendpkt->seqnum = nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  sendpkt->flags = flags | ((CONGESTION == 2) ? PKT_ECT : 0);
+  sendpkt->stream = message->stream;
+  sendpkt->streamseq = streamnext[message->stream]++;
+  sendpkt->nonce = 0;
+  memset(sendpkt->tag, 0, sizeof(sendpkt->tag));
+  if (done != NULL) {
+    memset(sendpkt->payload, 0, sizeof(sendpkt->payload));   /* the payload is not kept here */
+    sendpkt->checksum = HeaderChecksum(*sendpkt);
+    for (i = 0; i < 20; i++)
+      sendpkt->checksum += (int)(message->data[i]);
+    sendpkt->hdrchecksum = HeaderChecksum(*sendpkt);
+    sendpkt->parity = sendpkt->seqnum - sendpkt->acknum;
+  } else {
+    for (i = 0; i < 20; i++)
+      sendpkt->payload[i] = message->data[i];
+    SetChecksums(sendpkt);
+    if (AEAD)
+      Seal(sendpkt, A);
+  }
+  sendpkt->timestamp = currenttime();
+  sendpkt->msgtime = msgtime;
+  sendpkt->receiver = 0;   /* the channel sends a copy to every receiver */
+
+  zc_msg[nextseqnum] = done != NULL ? message : NULL;
+  zc_done[nextseqnum] = done;
+  acked[nextseqnum] = false;
+  ackedby[nextseqnum] = 0;
+  nak_holdoff[nextseqnum] = 0.0;
+  abandoned[nextseqnum] = false;
+  deadline[nextseqnum] = message->lifetime > 0.0 ? msgtime + message->lifetime : 0.0;
+  sent_delivered[nextseqnum] = delivered_count;
+  sent_delivered_time[nextseqnum] = delivered_time;
+
+  if (TRACE > 0) {
+    printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
+    printf("Sending packet %d to layer 3\n", nextseqnum);
+  }
 
-    tolayer3(A, sendpkt);
-    if (base == nextseqnum && !timer_running) {
-      starttimer(A, RTT);
-      timer_running = true;
+  SendBuffered(nextseqnum);
+  if (base == nextseqnum && !timer_running)
+    RestartTimer();
+  else if (TLP && probe_pending)
+    DelayProbe();
+
+  nextseqnum = (nextseqnum + 1) % SEQSPACE;
+}
+
+/* processor time used, in seconds.  A compression takes well under the tick of clock(), so
+   the nanosecond CPU clock is used where <time.h> offers it (POSIX) */
+static double CpuSeconds(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* bulk mode: compress the longest run of queued messages of one stream that fits in a
+   payload, and send it as one packet.  A message that does not compress goes alone, raw. */
+static void SendCoalesced(void)
+{
+  unsigned char raw[COALESCE * 20], trial[19], packed[19];
+  struct msg message = sendqueue[queuefirst];
+  float msgtime = queuetime[queuefirst];
+  double start = CpuSeconds();
+  int count = 0, size = 0, n;
+
+  for (n = 1; n <= COALESCE && n <= queuecount; n++) {
+    struct msg *next = &sendqueue[(queuefirst + n - 1) % SENDQUEUE];
+    int trysize;
+    if (next->stream != message.stream)
+      break;
+    memcpy(raw + (n - 1) * 20, next->data, 20);
+    trysize = LzCompress(raw, n * 20, trial, sizeof(trial));
+    if (trysize < 0)
+      break;
+    count = n;
+    size = trysize;
+    memcpy(packed, trial, size);
+  }
+  bulk_cpu += CpuSeconds() - start;
+  queuefirst = (queuefirst + (count > 0 ? count : 1)) % SENDQUEUE;
+  queuecount -= count > 0 ? count : 1;
+  if (count == 0) {
+    SendMessage(&message, msgtime, 0, NULL);
+    return;
+  }
+
+  if (TRACE > 0)
+    printf("----A: %d queued messages compressed into %d bytes\n", count, size);
+  message.data[0] = (char)size;
+  memcpy(message.data + 1, packed, size);
+  memset(message.data + 1 + size, 0, 19 - size);
+  SendMessage(&message, msgtime, PKT_COMPRESSED, NULL);   /* the oldest message's time, for latency */
+  bulk_messages += count;
+  bulk_packets++;
+  bulk_bytes += 1 + size;
+}
+
+/* send queued messages while the window, the inflight cap and pacing allow (rate based
+   and bulk modes) */
+static void TrySend(void)
+{
+  while (queuecount > 0) {
+    int outstanding = (nextseqnum + SEQSPACE - base) % SEQSPACE;
+    if (outstanding >= WINDOWSIZE
+        || (RATEBASED ? InFlight() >= RateWindow() : outstanding >= (int)cwnd))
+      return;   /* an ACK will make room */
+    if (currenttime() < pace_deadline)
+      return;   /* the timer wakes A for the next paced send */
+
+    if (COMPRESS) {
+      SendCoalesced();
+    } else {
+      SendMessage(&sendqueue[queuefirst], queuetime[queuefirst], 0, NULL);
+      queuefirst = (queuefirst + 1) % SENDQUEUE;
+      queuecount--;
     }
 
-    nextseqnum = (nextseqnum + 1) % SEQSPACE;
+    /* space packets at the pacing rate; send freely until there is a bandwidth estimate */
+    if (btlbw > 0.0)
+      pace_deadline = currenttime() + 1 / (pacing_gain * btlbw);
+  }
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+void A_output(struct msg message)
+{
+  int outstanding = (nextseqnum + SEQSPACE - base) % SEQSPACE;
+
+  if (RATEBASED || COMPRESS) {
+    if (queuecount < SENDQUEUE) {
+      sendqueue[(queuefirst + queuecount) % SENDQUEUE] = message;
+      queuetime[(queuefirst + queuecount) % SENDQUEUE] = currenttime();
+      queuecount++;
+      TrySend();
+      if (RATEBASED)
+        ArmTimer();
+    } else {
+      if (TRACE > 0) printf("----A: New message arrives, send queue is full\n");
+      window_full++;
+    }
+  } else if (outstanding < WINDOWSIZE && outstanding < (int)cwnd) {
+    SendMessage(&message, currenttime(), 0, NULL);
   } else {
     if (TRACE > 0) printf("----A: New message arrives, send window is full\n");
     window_full++;
   }
 }
 
+/* zero-copy send.  The send queue of the rate based and bulk modes and sealing need a
+   copy of their own, and a full window drops the message, so those are done by
+   A_output() and the message is handed back at once. */
+void A_output_zc(struct msg *message, sendcomplete done)
+{
+  int outstanding = (nextseqnum + SEQSPACE - base) % SEQSPACE;
+
+  if (RATEBASED || COMPRESS || AEAD || outstanding >= WINDOWSIZE || outstanding >= (int)cwnd) {
+    A_output(*message);
+    done(message);
+    return;
+  }
+  SendMessage(message, currenttime(), 0, done);
+}
+
+
+/* multicast: a receiver is missing buffer[seqnum].  The first NAK resends it to every
+   receiver; the NAKs from the others that follow are aggregated into that resend. */
+static void ResendNAKed(int seqnum)
+{
+  if (((seqnum + SEQSPACE - base) % SEQSPACE) >= ((nextseqnum + SEQSPACE - base) % SEQSPACE)
+      || acked[seqnum] || abandoned[seqnum])
+    return;
+  if (currenttime() < nak_holdoff[seqnum]) {
+    if (TRACE > 0)
+      printf("----A: NAK %d from receiver covered by the last resend\n", seqnum);
+    naks_aggregated++;
+    return;
+  }
+  if (TRACE > 0)
+    printf("----A: NAK %d received, resend packet to all receivers\n", seqnum);
+  nak_holdoff[seqnum] = currenttime() + NAKHOLDOFF;
+  SendBuffered(seqnum);
+  packets_resent++;
+}
 
 /* called from layer 3, when a packet arrives for layer 4
    In this practical this will always be an ACK as B never sends data.
 */
 void A_input(struct pkt packet)
 {
-  if (!IsCorrupted(packet)) {
+  if (!IsCorrupted(packet) && (!AEAD || Unseal(&packet, B))) {
     int acknum = packet.acknum;
 
     if (TRACE > 0) {
       printf("----A: uncorrupted ACK %d is received\n", acknum);
       printf("----A: ACK %d is not a duplicate\n", acknum);
     }
+    if (packet.flags & PKT_NAK) {
+      ResendNAKed(acknum);
+      return;
+    }
+    SampleRTT(packet);
+    if (CONGESTION == 2 && (packet.flags & PKT_ECE))
+      ReduceWindow();
 
-    if (!acked[acknum]) {
+    /* B has skipped past the abandoned packets: slide the window over them */
+    if (packet.flags & PKT_FORWARD) {
+      if (acknum == forwardseq) {
+        /* ACKs may already have slid base past the skip; then there is nothing to skip */
+        if ((forwardseq + SEQSPACE - base) % SEQSPACE > (nextseqnum + SEQSPACE - base) % SEQSPACE) {
+          forwardseq = NOTINUSE;
+          return;
+        }
+        if (NRECEIVERS > 1) {
+          /* slide only once every receiver has skipped; the skip is sent again on the
+             next timeout for those that lost it */
+          skippedby |= 1 << packet.receiver;
+          if (skippedby != ALLRECEIVERS)
+            return;
+        }
+        while (base != forwardseq) {
+          acked[base] = false;
+          abandoned[base] = false;
+          base = (base + 1) % SEQSPACE;
+        }
+        forwardseq = NOTINUSE;
+        while (acked[base] && base != nextseqnum) {
+          acked[base] = false;
+          base = (base + 1) % SEQSPACE;
+        }
+        if (base == nextseqnum && timer_running) {
+          stoptimer(A);
+          timer_running = false;
+        }
+        if (RATEBASED || COMPRESS)
+          TrySend();
+        if (RATEBASED)
+          ArmTimer();
+      }
+      return;
+    }
+
+    /* with probes or an adaptive RTO, ignore ACKs for packets outside the window, e.g. a
+       late ACK for a resent packet.  The assignment's fixed-RTO sender keeps taking them: they
+       restart its timer, without which it collapses under load */
+    if ((!(TLP || ADAPTIVE_RTO)
+         || ((acknum + SEQSPACE - base) % SEQSPACE) < ((nextseqnum + SEQSPACE - base) % SEQSPACE))
+        && !acked[acknum]) {
+      if (NRECEIVERS > 1) {
+        /* the window advances on the slowest receiver */
+        ackedby[acknum] |= 1 << packet.receiver;
+        if (ackedby[acknum] != ALLRECEIVERS)
+          return;
+      }
       acked[acknum] = true;
       new_ACKs++;
+      Release(acknum);
+      if (CONGESTION > 0 && cwnd < WINDOWSIZE) {
+        /* additive increase: about one packet per window of ACKs */
+        cwnd += 1.0 / cwnd;
+        if (cwnd > WINDOWSIZE)
+          cwnd = WINDOWSIZE;
+      }
+      if (abandoned[acknum]) {
+        /* a late ACK: the message got through after all */
+        abandoned[acknum] = false;
+        messages_abandoned--;
+      }
+      if (RATEBASED)
+        UpdateModel(acknum);
       
       while (acked[base]) {
         acked[base] = false;
@@ -118,12 +859,12 @@ void A_input(struct pkt packet)
           timer_running = false;
         }
       } else {
-        if (timer_running) {
-          stoptimer(A);
-        }
-        starttimer(A, RTT);
-        timer_running = true;
+        RestartTimer();
       }
+      if (RATEBASED || COMPRESS)
+        TrySend();
+      if (RATEBASED)
+        ArmTimer();
     }
   } else {
     if (TRACE > 0)
@@ -135,16 +876,42 @@ void A_input(struct pkt packet)
 void A_timerinterrupt(void)
 {
   int i;
+
+  timer_running = false;
+
+  /* woken early for a tail loss probe or a paced send rather than a timeout */
+  if ((TLP || RATEBASED) && (base == nextseqnum || currenttime() < rto_deadline)) {
+    if (TLP && probe_pending && base != nextseqnum && currenttime() >= probe_deadline) {
+      probe_pending = false;
+      SendProbe();
+    }
+    if (RATEBASED)
+      TrySend();
+    ArmTimer();
+    return;
+  }
+
   if (TRACE > 0) printf("----A: time out,resend packets!\n");
-  
+  probe_pending = false;
+  if (CONGESTION > 0)
+    ReduceWindow();
+  AbandonExpired();
+
   for (i = 0; i < WINDOWSIZE; i++) {
     int idx = (base + i) % SEQSPACE;
-    if (!acked[idx] && ((nextseqnum + SEQSPACE - base) % SEQSPACE > i)) {
-      tolayer3(A, buffer[idx]);
+    if (!acked[idx] && !abandoned[idx] && ((nextseqnum + SEQSPACE - base) % SEQSPACE > i)) {
+      SendBuffered(idx);
       packets_resent++;
     }
   }
-  starttimer(A, RTT);
+  if (TLP || RATEBASED) {
+    rto_deadline = currenttime() + rto;
+    if (RATEBASED)
+      TrySend();
+    ArmTimer();
+    return;
+  }
+  starttimer(A, rto);
   timer_running = true;
 }
 
@@ -158,22 +925,333 @@ void A_init(void)
   base = 0;
   nextseqnum = 0;
   timer_running = false;
-  for (i = 0; i < SEQSPACE; i++) acked[i] = false;
+  srtt = 0.0;
+  rttvar = 0.0;
+  rto = RTT;
+  probe_pending = false;
+  forwardseq = NOTINUSE;
+  skippedby = 0;
+  cwnd = WINDOWSIZE;
+  recovery_end = 0.0;
+  for (i = 0; i < NPATHS; i++) pathrtt[i] = 0.0;
+  nextpath = 0;
+  queuefirst = 0;
+  queuecount = 0;
+  pace_deadline = 0.0;
+  delivered_count = 0;
+  delivered_time = 0.0;
+  btlbw = 0.0;
+  minrtt = 0.0;
+  minrtt_stamp = 0.0;
+  round_count = 0;
+  round_end = 0;
+  bbr_state = STARTUP;
+  pacing_gain = STARTUPGAIN;
+  cwnd_gain = STARTUPGAIN;
+  full_bw = 0.0;
+  full_bw_rounds = 0;
+  cycle_index = 2;
+  cycle_stamp = 0.0;
+  for (i = 0; i < BWFILTER; i++) bwsamples[i] = 0.0;
+  for (i = 0; i < NSTREAMS; i++) streamnext[i] = 0;
+  for (i = 0; i < SEQSPACE; i++) {
+    acked[i] = false;
+    abandoned[i] = false;
+    zc_msg[i] = NULL;
+  }
+  if (AEAD)
+    AeadSetKey(&aead_key, aead_secret);
+  sealed[A] = 0;
 }
 
 
 
 /********* Receiver (B)  variables and procedures ************/
 
-static struct pkt recv_buffer[SEQSPACE];
-static bool received[SEQSPACE];
+static struct pkt recv_buffer[SEQSLOTS];
+static bool received[SEQSLOTS];
+static bool delivered[SEQSLOTS];      /* recv_buffer[i] already went to layer 5 ahead of expectedseqnum */
 static int expectedseqnum;
+static int streamexpected[NSTREAMS];  /* position of the next message to deliver on each stream */
+static float arrival[SEQSLOTS];       /* time recv_buffer[i] arrived */
+static struct pkt pool[COMBINEPOOL];  /* corrupted copies kept for combining */
+static int poolseq[COMBINEPOOL];      /* the seqnum each copy was sent with */
+static int poolsize;
+static int poolnext;                  /* next copy replaced when the pool is full */
+static float nak_time[SEQSLOTS];      /* multicast: time recv_buffer[i] may be NAKed again */
+
+/* multicast: the variables above hold the state of one receiver at a time, the others
+   are kept here and swapped in when a packet arrives for them */
+#define RECEIVER_STATE(X) X(recv_buffer) X(received) X(delivered) X(expectedseqnum) \
+  X(streamexpected) X(arrival) X(pool) X(poolseq) X(poolsize) X(poolnext) X(nak_time)
+#define RECEIVER_SIZEOF(v) + sizeof(v)
+static char receiver_state[NRECEIVERS][0 RECEIVER_STATE(RECEIVER_SIZEOF)];
+static int receiver;                  /* receiver whose state the variables above hold */
+
+static void SaveReceiver(void)
+{
+  char *p = receiver_state[receiver];
+#define SAVE_RECEIVER(v) memcpy(p, &v, sizeof(v)); p += sizeof(v);
+  RECEIVER_STATE(SAVE_RECEIVER)
+#undef SAVE_RECEIVER
+}
+
+static void SwitchReceiver(int r)
+{
+  char *p = receiver_state[r];
 
+  if (r == receiver)
+    return;
+  SaveReceiver();
+#define LOAD_RECEIVER(v) memcpy(&v, p, sizeof(v)); p += sizeof(v);
+  RECEIVER_STATE(LOAD_RECEIVER)
+#undef LOAD_RECEIVER
+  receiver = r;
+}
+
+/* pass recv_buffer[seqnum] to layer 5 */
+static void Deliver(int seqnum)
+{
+  struct pkt *packet = &recv_buffer[seqnum];
+
+  if (COMPRESS && (packet->flags & PKT_COMPRESSED)) {
+    unsigned char raw[COALESCE * 20];
+    double start = CpuSeconds();
+    int size = LzDecompress((unsigned char *)packet->payload + 1, (unsigned char)packet->payload[0],
+                            raw, sizeof(raw));
+    int i;
+
+    bulk_cpu += CpuSeconds() - start;
+    for (i = 0; i + 20 <= size; i += 20) {
+      tolayer5(B, (char *)raw + i);
+      record_latency(packet->stream, currenttime() - packet->msgtime);
+    }
+  } else {
+    tolayer5(B, packet->payload);
+    record_latency(packet->stream, currenttime() - packet->msgtime);
+  }
+  if (currenttime() > arrival[seqnum])
+    record_reorder(currenttime() - arrival[seqnum]);
+  delivered[seqnum] = true;
+  packets_received++;
+  if (packet->streamseq >= streamexpected[packet->stream])
+    streamexpected[packet->stream] = packet->streamseq + 1;
+}
+
+/* deliver the buffered packets that are next in their stream's order.  A gap only
+   holds back later packets of its own stream, not those of the other streams.
+   Packets of one stream have increasing sequence numbers, so one pass finds a run.
+   With a single stream there is nothing to find ahead of SlideWindow(), which
+   delivers in order without scanning the window. */
+static void DeliverStream(int stream)
+{
+  int i;
+
+  if (NSTREAMS == 1)
+    return;
+  for (i = 0; i < WINDOWSIZE; i++) {
+    int idx = (expectedseqnum + i) % SEQSPACE;
+    if (received[idx] && !delivered[idx] && recv_buffer[idx].stream == stream
+        && recv_buffer[idx].streamseq == streamexpected[stream])
+      Deliver(idx);
+  }
+}
+
+/* the receive window left seqnum: drop the corrupted copies of it, the slot will carry
+   a different packet on the next lap with checksums that may well be the same */
+static void Evict(int seqnum)
+{
+  int i;
+
+  for (i = 0; i < poolsize; i++)
+    if (poolseq[i] == seqnum) {
+      pool[i] = pool[--poolsize];
+      poolseq[i] = poolseq[poolsize];
+      i--;
+    }
+  if (poolnext >= poolsize)
+    poolnext = 0;
+}
+
+/* slide the receive window over the packets received so far */
+static void SlideWindow(void)
+{
+  while (received[expectedseqnum]) {
+    /* only left undelivered when a forward-skip removed an earlier packet of its stream */
+    if (!delivered[expectedseqnum]) {
+      Deliver(expectedseqnum);
+      DeliverStream(recv_buffer[expectedseqnum].stream);
+    }
+    received[expectedseqnum] = false;
+    delivered[expectedseqnum] = false;
+    nak_time[expectedseqnum] = 0.0;
+    if (COMBINE)
+      Evict(expectedseqnum);
+    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+  }
+}
+
+/* A abandoned packets from first up to seqnum: deliver what arrived, skip the holes */
+static void SkipTo(int first, int seqnum)
+{
+  /* act only if B is still inside the abandoned range, a late forward-skip must not
+     move it back */
+  if ((expectedseqnum + SEQSPACE - first) % SEQSPACE >= (seqnum + SEQSPACE - first) % SEQSPACE)
+    return;
+
+  while (expectedseqnum != seqnum) {
+    if (received[expectedseqnum]) {
+      if (!delivered[expectedseqnum])
+        Deliver(expectedseqnum);
+    } else {
+      if (TRACE > 0)
+        printf("----B: skipping abandoned packet %d\n", expectedseqnum);
+      messages_skipped++;
+    }
+    received[expectedseqnum] = false;
+    delivered[expectedseqnum] = false;
+    nak_time[expectedseqnum] = 0.0;
+    if (COMBINE)
+      Evict(expectedseqnum);
+    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
+  }
+  SlideWindow();
+}
+
+/* the channel overwrites one field at a time and never the checksums, so each part
+   of a corrupted copy can be checked on its own */
+static bool HeaderIntact(struct pkt packet)
+{
+  return packet.hdrchecksum == HeaderChecksum(packet);
+}
+
+static bool PayloadIntact(struct pkt packet)
+{
+  return packet.checksum - packet.hdrchecksum == ComputeChecksum(packet) - HeaderChecksum(packet);
+}
+
+/* the seqnum a corrupted copy was sent with: the channel never touches parity, so whichever
+   of seqnum and acknum is intact gives it.  NOTINUSE if both were overwritten. */
+static int SentSeqnum(struct pkt packet)
+{
+  struct pkt fixed = packet;
+
+  if (HeaderIntact(packet))
+    return packet.seqnum;
+  fixed.seqnum = packet.acknum + packet.parity;
+  if (HeaderIntact(fixed))
+    return fixed.seqnum;
+  fixed = packet;
+  fixed.acknum = packet.seqnum - packet.parity;
+  if (HeaderIntact(fixed))
+    return packet.seqnum;
+  return NOTINUSE;
+}
+
+/* try to rebuild a corrupted packet, from its parity field or by combining it with a
+   corrupted copy of the same packet received earlier.  Copies of one packet carry the
+   same checksums and parity, and the pool holds copies of packets in the receive window
+   only.  Returns true if the packet is now intact, otherwise keeps it. */
+static bool Repair(struct pkt *packet)
+{
+  int seqnum = SentSeqnum(*packet);
+  int i, j;
+
+  if (COMBINE == 2 && !HeaderIntact(*packet)) {
+    struct pkt fixed = *packet;
+    fixed.seqnum = packet->acknum + packet->parity;
+    if (!HeaderIntact(fixed)) {
+      fixed = *packet;
+      fixed.acknum = packet->seqnum - packet->parity;
+    }
+    if (HeaderIntact(fixed))
+      *packet = fixed;
+  }
+
+  for (i = 0; i < poolsize && IsCorrupted(*packet); i++) {
+    struct pkt combined = *packet;
+    if (pool[i].checksum != packet->checksum || pool[i].hdrchecksum != packet->hdrchecksum
+        || pool[i].parity != packet->parity || (seqnum != NOTINUSE && seqnum != poolseq[i]))
+      continue;
+    if (HeaderIntact(*packet) && PayloadIntact(pool[i])) {
+      for (j = 0; j < 20; j++)
+        combined.payload[j] = pool[i].payload[j];
+    } else if (PayloadIntact(*packet) && HeaderIntact(pool[i])) {
+      combined.seqnum = pool[i].seqnum;
+      combined.acknum = pool[i].acknum;
+    } else
+      continue;
+    if (!IsCorrupted(combined)) {
+      *packet = combined;
+      pool[i] = pool[--poolsize];
+      poolseq[i] = poolseq[poolsize];
+    }
+  }
+
+  if (IsCorrupted(*packet)) {
+    /* keep it only if it can be told apart from a copy of a packet on another lap */
+    if (seqnum == NOTINUSE || (seqnum + SEQSPACE - expectedseqnum) % SEQSPACE >= WINDOWSIZE
+        || received[seqnum])
+      return false;
+    if (poolsize < COMBINEPOOL) {
+      pool[poolsize] = *packet;
+      poolseq[poolsize++] = seqnum;
+    } else {
+      pool[poolnext] = *packet;          /* replace the copies in turn */
+      poolseq[poolnext] = seqnum;
+      poolnext = (poolnext + 1) % COMBINEPOOL;
+    }
+    return false;
+  }
+  if (TRACE > 0)
+    printf("----B: packet %d rebuilt from corrupted copies\n", packet->seqnum);
+  packets_repaired++;
+  return true;
+}
+
+/* multicast: NAK the packets missing below seqnum, just arrived on 'path' */
+static void SendNAKs(int seqnum, int path)
+{
+  struct pkt nakpkt;
+  int i, idx;
+
+  for (idx = expectedseqnum; idx != seqnum; idx = (idx + 1) % SEQSPACE) {
+    if (received[idx] || currenttime() < nak_time[idx])
+      continue;
+    if (TRACE > 0)
+      printf("----B: receiver %d is missing packet %d, send NAK!\n", receiver, idx);
+    nakpkt.seqnum = idx;
+    nakpkt.acknum = idx;
+    nakpkt.flags = PKT_NAK;
+    nakpkt.stream = 0;
+    nakpkt.streamseq = 0;
+    for (i = 0; i < 20; i++)
+      nakpkt.payload[i] = '0';
+    nakpkt.nonce = 0;
+    memset(nakpkt.tag, 0, sizeof(nakpkt.tag));
+    SetChecksums(&nakpkt);
+    if (AEAD)
+      Seal(&nakpkt, B);
+    nakpkt.timestamp = currenttime();
+    nakpkt.msgtime = currenttime();
+    nakpkt.path = path;
+    nakpkt.receiver = receiver;
+    tolayer3(B, nakpkt);
+    nak_time[idx] = currenttime() + NAKINTERVAL;
+    naks_sent++;
+  }
+}
 
 /* called from layer 3, when a packet arrives for layer 4 at B*/
 void B_input(struct pkt packet)
 {
-  if (!IsCorrupted(packet)) {
+  bool repaired = false;
+
+  if (NRECEIVERS > 1)
+    SwitchReceiver(packet.receiver);
+  if (COMBINE && IsCorrupted(packet))
+    repaired = Repair(&packet);
+  if (!IsCorrupted(packet) && (!AEAD || Unseal(&packet, A))) {
     int seqnum = packet.seqnum;
     struct pkt ackpkt;
     int i;
@@ -183,22 +1261,37 @@ void B_input(struct pkt packet)
 
     ackpkt.seqnum = seqnum;
     ackpkt.acknum = seqnum;
+    ackpkt.flags = packet.flags & PKT_FORWARD;
+    if (packet.flags & PKT_CE)
+      ackpkt.flags |= PKT_ECE;   /* echo the congestion mark back to A */
+    ackpkt.stream = packet.stream;
+    ackpkt.streamseq = packet.streamseq;
     for (i = 0; i < 20; i++) 
       ackpkt.payload[i] = '0';
-    ackpkt.checksum = ComputeChecksum(ackpkt);
+    ackpkt.nonce = 0;
+    memset(ackpkt.tag, 0, sizeof(ackpkt.tag));
+    SetChecksums(&ackpkt);
+    if (AEAD)
+      Seal(&ackpkt, B);
+    ackpkt.timestamp = packet.timestamp;  /* echo the sender's timestamp */
+    ackpkt.msgtime = packet.msgtime;
+    ackpkt.path = packet.path;            /* return on the same path, so A can time it */
+    ackpkt.receiver = receiver;
 
     tolayer3(B, ackpkt);
 
-    if (((seqnum + SEQSPACE - expectedseqnum) % SEQSPACE) < WINDOWSIZE && !received[seqnum]) {
+    if (packet.flags & PKT_FORWARD) {
+      SkipTo(packet.acknum, seqnum);
+    } else if (((seqnum + SEQSPACE - expectedseqnum) % SEQSPACE) < WINDOWSIZE && !received[seqnum]) {
+      if (repaired)
+        repairs_new++;
+      if (NRECEIVERS > 1)
+        SendNAKs(seqnum, packet.path);
       received[seqnum] = true;
       recv_buffer[seqnum] = packet;
-
-      while (received[expectedseqnum]) {
-        tolayer5(B, recv_buffer[expectedseqnum].payload);
-        received[expectedseqnum] = false;
-        expectedseqnum = (expectedseqnum + 1) % SEQSPACE;
-        packets_received++;
-      }
+      arrival[seqnum] = currenttime();
+      DeliverStream(packet.stream);
+      SlideWindow();
     }
   } else {
     if (TRACE > 0)
@@ -212,7 +1305,20 @@ void B_init(void)
 {
   int i;
   expectedseqnum = 0;
-  for (i = 0; i < SEQSPACE; i++) received[i] = false;
+  for (i = 0; i < NSTREAMS; i++) streamexpected[i] = 0;
+  if (AEAD)
+    AeadSetKey(&aead_key, aead_secret);
+  sealed[B] = 0;
+  poolsize = 0;
+  poolnext = 0;
+  for (i = 0; i < SEQSPACE; i++) {
+    received[i] = false;
+    delivered[i] = false;
+    nak_time[i] = 0.0;
+  }
+  for (receiver = 0; receiver < NRECEIVERS; receiver++)
+    SaveReceiver();
+  receiver = 0;
 }
 
 /******************************************************************************
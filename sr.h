@@ -3,6 +3,10 @@ extern void B_init(void);
 extern void A_input(struct pkt);
 extern void B_input(struct pkt);
 extern void A_output(struct msg);
+/* zero-copy send: A keeps a reference to message instead of a copy, and calls done(message)
+   once it no longer needs it; the caller must leave the message alone until then */
+typedef void (*sendcomplete)(struct msg *);
+extern void A_output_zc(struct msg *, sendcomplete);
 extern void A_timerinterrupt(void);
 
 /* included for extension to bidirectional communication */
@@ -0,0 +1,196 @@
+/**********************************************************************
+   Tuner for WINDOWSIZE and RTT (the timeout) of sr.c or gbn.c
+
+   Given the channel parameters the emulator asks for, the tuner builds
+   the protocol once for every window and timeout on a grid, runs short
+   simulations and keeps the better half of the settings, doubling the
+   number of messages each round (successive halving) until one setting
+   is left.  Settings whose average message latency is above the bound
+   never win.  It prints the goodput curve over the window from the
+   first round and the recommended setting.
+
+   Build and run from the directory holding the protocol sources:
+     gcc tuner.c -o tuner
+     ./tuner sr 1000 0.1 0.1 2 10 [latency bound]
+   the arguments being the protocol, the number of messages, the loss
+   and corruption probabilities, the direction they apply to and the
+   average time between messages, as entered into the emulator.
+
+   The assignment still has to be submitted with WINDOWSIZE 6 and RTT 16.
+**********************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NWINDOWS 10
+#define NTIMEOUTS 7
+#define NCANDIDATES (NWINDOWS * NTIMEOUTS)
+#define FIRSTROUND 16   /* the first round runs 1/FIRSTROUND of the messages */
+#define MINMESSAGES 50  /* but at least this many */
+
+static const int windows[NWINDOWS] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+static const float timeouts[NTIMEOUTS] = { 8.0, 12.0, 16.0, 24.0, 32.0, 48.0, 64.0 };
+
+struct candidate {
+  int window;
+  float timeout;
+  char binary[64];
+  float goodput;      /* from the last run */
+  float latency;      /* average latency from the last run */
+  int alive;          /* still in the search */
+};
+
+static struct candidate candidates[NCANDIDATES];
+static const char *protocol;
+static float loss, corrupt, lambda, latencybound;
+static int direction;
+
+/* build the protocol with the candidate's window and timeout */
+static int Build(struct candidate *c)
+{
+  char command[256];
+
+  snprintf(c->binary, sizeof(c->binary), "/tmp/tuner-%d-%s-w%d-t%g",
+           (int)getpid(), protocol, c->window, c->timeout);
+  snprintf(command, sizeof(command),
+           "gcc -O2 -DWINDOWSIZE=%d -DRTT=%f emulator.c %s.c -o %s -lm",
+           c->window, c->timeout, protocol, c->binary);
+  return system(command) == 0;
+}
+
+/* simulate the candidate with the given number of messages */
+static void Run(struct candidate *c, int messages)
+{
+  char input[64], command[256], line[256];
+  FILE *fp;
+  float value, sum = 0.0;
+  int streams = 0;
+
+  snprintf(input, sizeof(input), "/tmp/tuner-%d.in", (int)getpid());
+  fp = fopen(input, "w");
+  if (fp == NULL) {
+    printf("unable to write %s\n", input);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(fp, "%d\n%f\n%f\n", messages, loss, corrupt);
+  if (loss != 0.0 || corrupt != 0.0)
+    fprintf(fp, "%d\n", direction);
+  fprintf(fp, "%f\n0\n", lambda);
+  fclose(fp);
+
+  c->goodput = 0.0;
+  c->latency = 0.0;
+  snprintf(command, sizeof(command), "%s < %s", c->binary, input);
+  fp = popen(command, "r");
+  if (fp == NULL)
+    return;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char *p;
+    if ((p = strstr(line, "goodput (messages delivered per time unit):")) != NULL)
+      sscanf(p + strlen("goodput (messages delivered per time unit):"), "%f", &c->goodput);
+    else if ((p = strstr(line, "avg ")) != NULL && strstr(line, "latency of messages") != NULL
+             && sscanf(p + 4, "%f", &value) == 1) {
+      sum += value;
+      streams++;
+    }
+  }
+  pclose(fp);
+  remove(input);
+  if (streams > 0)
+    c->latency = sum / streams;
+}
+
+/* goodput, or -1 when the latency bound is broken */
+static float Score(const struct candidate *c)
+{
+  if (latencybound > 0.0 && c->latency > latencybound)
+    return -1.0;
+  return c->goodput;
+}
+
+static int CompareScore(const void *a, const void *b)
+{
+  float sa = Score(*(struct candidate * const *)a), sb = Score(*(struct candidate * const *)b);
+  return (sa < sb) - (sa > sb);
+}
+
+int main(int argc, char *argv[])
+{
+  struct candidate *ranked[NCANDIDATES];
+  int messages, budget, alive, round;
+  int i, j;
+
+  if (argc < 7) {
+    printf("usage: %s sr|gbn messages loss corrupt direction lambda [latency bound]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  protocol = argv[1];
+  messages = atoi(argv[2]);
+  loss = atof(argv[3]);
+  corrupt = atof(argv[4]);
+  direction = atoi(argv[5]);
+  lambda = atof(argv[6]);
+  latencybound = argc > 7 ? atof(argv[7]) : 0.0;
+
+  alive = 0;
+  for (i = 0; i < NWINDOWS; i++)
+    for (j = 0; j < NTIMEOUTS; j++) {
+      struct candidate *c = &candidates[alive];
+      c->window = windows[i];
+      c->timeout = timeouts[j];
+      c->alive = Build(c);
+      if (!c->alive) {
+        printf("unable to build %s with window %d and timeout %g\n", protocol, c->window, c->timeout);
+        return EXIT_FAILURE;
+      }
+      alive++;
+    }
+
+  budget = messages / FIRSTROUND;
+  if (budget < MINMESSAGES)
+    budget = MINMESSAGES;
+  for (round = 0; ; round++) {
+    int n = 0;
+
+    if (budget > messages || alive <= 2)
+      budget = messages;
+    for (i = 0; i < NCANDIDATES; i++)
+      if (candidates[i].alive) {
+        Run(&candidates[i], budget);
+        ranked[n++] = &candidates[i];
+      }
+    qsort(ranked, n, sizeof(ranked[0]), CompareScore);
+
+    if (round == 0) {
+      /* the goodput curve: the best timeout for each window */
+      printf("goodput over %d messages\n", budget);
+      printf("window  timeout  goodput   avg latency\n");
+      for (i = 0; i < NWINDOWS; i++)
+        for (j = 0; j < n; j++)
+          if (ranked[j]->window == windows[i]) {
+            printf("%6d  %7.1f  %f  %f%s\n", ranked[j]->window, ranked[j]->timeout,
+                   ranked[j]->goodput, ranked[j]->latency,
+                   Score(ranked[j]) < 0.0 ? "  (over latency bound)" : "");
+            break;
+          }
+    }
+
+    if (budget == messages || n == 1)
+      break;
+    alive = (n + 1) / 2;
+    for (j = alive; j < n; j++)
+      ranked[j]->alive = 0;
+    budget *= 2;
+  }
+
+  if (Score(ranked[0]) < 0.0)
+    printf("no setting met the latency bound of %f\n", latencybound);
+  else
+    printf("recommended: WINDOWSIZE %d, RTT %.1f (goodput %f, avg latency %f over %d messages)\n",
+           ranked[0]->window, ranked[0]->timeout, ranked[0]->goodput, ranked[0]->latency, budget);
+
+  for (i = 0; i < NCANDIDATES; i++)
+    remove(candidates[i].binary);
+  return EXIT_SUCCESS;
+}